@@ -0,0 +1,93 @@
+#include "Mem.h"
+#include <cstdlib>
+#include <new>
+
+// global new and delete for --mem-report
+//
+// every block gets a header with its size and the tag memreport charged
+// it to, so it can be taken off the same counts when freed. blocks made
+// while not counting have tag 0 and are never counted. the header is 16
+// bytes so blocks keep malloc's alignment
+
+// block header
+struct Header {
+        uint64_t        size;   // bytes asked for
+        uint64_t        tag;    // memreport tag or 0
+};
+
+static void *alloc(size_t n)
+{
+        auto h = (Header *)malloc(sizeof(Header) + n);
+
+        if (h == nullptr)
+                return nullptr;
+        h->size = n;
+        h->tag = memreport.On() ? memreport.Alloc(n) : 0;
+        return h + 1;
+}
+
+static void release(void *p)
+{
+        if (p == nullptr)
+                return;
+
+        auto h = (Header *)p - 1;
+        if (h->tag)
+                memreport.Free(h->tag, h->size);
+        free(h);
+}
+
+void *operator new(size_t n)
+{
+        auto p = alloc(n);
+
+        if (p == nullptr)
+                throw std::bad_alloc{};
+        return p;
+}
+
+void *operator new[](size_t n)
+{
+        return operator new(n);
+}
+
+void *operator new(size_t n, const std::nothrow_t &) noexcept
+{
+        return alloc(n);
+}
+
+void *operator new[](size_t n, const std::nothrow_t &) noexcept
+{
+        return alloc(n);
+}
+
+void operator delete(void *p) noexcept
+{
+        release(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+        release(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+        release(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+        release(p);
+}
+
+// sized delete, called by code built for c++14 and later
+void operator delete(void *p, size_t) noexcept
+{
+        release(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+        release(p);
+}
@@ -0,0 +1,282 @@
+#include "Error.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// write a test of multiply and divide by constants
+//
+// path.c is a program for mycc with a function for each constant, type
+// of operand and operator, reading its operand from a global. path-check.c
+// is a C driver that sets the globals to edge and random values, calls
+// the functions and compares each result with what the C compiler makes
+// of the same expression. mycc evaluates everything in 64 bits, so the
+// driver does too: char is 0 to 255 and ints are widened before the
+// operator
+static void usage_exit(void)
+{
+        fprintf(stderr, "mycc-arith path\n");
+        exit(1);
+}
+
+static const char *types[] = {"char", "int", "long"};
+static const char tchar[] = {'c', 'i', 'l'};
+
+// get constants to multiply and divide by: everything small, powers of
+// two and their neighbours, and some with awkward magic numbers
+static std::vector<long> constants(void)
+{
+        std::vector<long> v;
+
+        for (long c = -300; c <= 300; c++) {
+                if (c)
+                        v.push_back(c);
+        }
+        for (int k = 9; k <= 30; k++) {
+                long p = 1l << k;
+                for (long c : {p - 1, p, p + 1}) {
+                        v.push_back(c);
+                        v.push_back(-c);
+                }
+        }
+        for (long c : {641l, 6700417l, 65535l, 65537l, 1000000007l,
+                        123456789l, 3l << 20, 5l << 24, 2147483647l})
+        {
+                v.push_back(c);
+                v.push_back(-c);
+        }
+        v.push_back(INT32_MIN);
+        return v;
+}
+
+// write constant as a mycc expression; literals have no sign
+static std::string lit(long c)
+{
+        if (c == INT32_MIN)
+                return "(0 - 2147483647 - 1)";
+        if (c < 0)
+                return "(0 - " + std::to_string(-c) + ")";
+        return std::to_string(c);
+}
+
+static FILE *create(const std::string &path)
+{
+        auto fp = fopen(path.c_str(), "w");
+
+        if (fp == nullptr)
+                error("could not open %s", path.c_str());
+        return fp;
+}
+
+static void finish(FILE *fp, const std::string &path)
+{
+        if (ferror(fp) || fclose(fp) == EOF)
+                error("could not write %s", path.c_str());
+}
+
+// write program for mycc
+static void program(const std::string &path, const std::vector<long> &cs)
+{
+        auto fp = create(path);
+
+        for (int t = 0; t < 3; t++)
+                fprintf(fp, "%s a%c;\n", types[t], tchar[t]);
+        for (size_t i = 0; i < cs.size(); i++) {
+                auto c = lit(cs[i]);
+                for (int t = 0; t < 3; t++) {
+                        fprintf(fp, "long d%c_%zu() { return (a%c / %s); }\n"
+                                    "long m%c_%zu() { return (a%c * %s); }\n",
+                                    tchar[t], i, tchar[t], c.c_str(),
+                                    tchar[t], i, tchar[t], c.c_str());
+                }
+        }
+        finish(fp, path);
+}
+
+// body of driver after the table of tests
+static const char *driver =
+"static long checked, bad;\n"
+"\n"
+"// splitmix64\n"
+"static uint64_t rng = 1;\n"
+"static uint64_t next(void)\n"
+"{\n"
+"        uint64_t z = (rng += 0x9e3779b97f4a7c15ull);\n"
+"        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;\n"
+"        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;\n"
+"        return z ^ (z >> 31);\n"
+"}\n"
+"\n"
+"static void set(int t, long x)\n"
+"{\n"
+"        if (t == 0)\n"
+"                ac = (unsigned char)x;\n"
+"        else if (t == 1)\n"
+"                ai = (int)x;\n"
+"        else\n"
+"                al = x;\n"
+"}\n"
+"\n"
+"// x as mycc reads it back from a global of type t\n"
+"static long value(int t, long x)\n"
+"{\n"
+"        return t == 0 ? (unsigned char)x : t == 1 ? (int)x : x;\n"
+"}\n"
+"\n"
+"static void one(int t, long x, size_t i)\n"
+"{\n"
+"        long c = tests[i].c, v = value(t, x), got;\n"
+"\n"
+"        checked += 2;\n"
+"        if (!(v == INT64_MIN && c == -1)) {\n"
+"                got = tests[i].div[t]();\n"
+"                if (got != v / c && bad++ < 20)\n"
+"                        printf(\"%s %ld / %ld = %ld, want %ld\\n\",\n"
+"                               types[t], v, c, got, v / c);\n"
+"        }\n"
+"        got = tests[i].mul[t]();\n"
+"        long want = (long)((uint64_t)v * (uint64_t)c);\n"
+"        if (got != want && bad++ < 20)\n"
+"                printf(\"%s %ld * %ld = %ld, want %ld\\n\",\n"
+"                       types[t], v, c, got, want);\n"
+"}\n"
+"\n"
+"// check x against every constant\n"
+"static void all(int t, long x)\n"
+"{\n"
+"        set(t, x);\n"
+"        for (size_t i = 0; i < NTESTS; i++)\n"
+"                one(t, x, i);\n"
+"}\n"
+"\n"
+"// check x against one constant\n"
+"static void with(int t, long x, size_t i)\n"
+"{\n"
+"        set(t, x);\n"
+"        one(t, x, i);\n"
+"}\n"
+"\n"
+"int main(int argc, char **argv)\n"
+"{\n"
+"        int full = argc > 1 && strcmp(argv[1], \"-f\") == 0;\n"
+"\n"
+"        // every char\n"
+"        for (long x = 0; x < 256; x++)\n"
+"                all(0, x);\n"
+"\n"
+"        // ints near zero and the ends, multiples of each constant and\n"
+"        // their neighbours, and random ones\n"
+"        for (long x = -70000; x <= 70000; x++)\n"
+"                all(1, x);\n"
+"        for (long x = 0; x < 20000; x++) {\n"
+"                all(1, INT32_MIN + x);\n"
+"                all(1, INT32_MAX - x);\n"
+"        }\n"
+"        for (size_t i = 0; i < NTESTS; i++) {\n"
+"                long c = tests[i].c;\n"
+"                for (long k = -2000; k <= 2000; k++) {\n"
+"                        for (long e = -1; e <= 1; e++) {\n"
+"                                long x = k * c + e;\n"
+"                                if (x >= INT32_MIN && x <= INT32_MAX)\n"
+"                                        with(1, x, i);\n"
+"                        }\n"
+"                }\n"
+"        }\n"
+"        for (int n = 0; n < 100000; n++)\n"
+"                all(1, (int)next());\n"
+"\n"
+"        // longs near the ends, large multiples of each constant and\n"
+"        // their neighbours, and random ones\n"
+"        for (long x = 0; x < 20000; x++) {\n"
+"                all(2, INT64_MIN + x);\n"
+"                all(2, INT64_MAX - x);\n"
+"        }\n"
+"        for (size_t i = 0; i < NTESTS; i++) {\n"
+"                long c = tests[i].c;\n"
+"                long kmax = INT64_MAX / (c < 0 ? -c : c);\n"
+"                for (int n = 0; n < 2000; n++) {\n"
+"                        long k = (long)(next() % kmax) * (n & 1 ? -1 : 1);\n"
+"                        for (long e = -1; e <= 1; e++)\n"
+"                                with(2, (long)((uint64_t)k * c + e), i);\n"
+"                }\n"
+"        }\n"
+"        for (int n = 0; n < 100000; n++)\n"
+"                all(2, (long)next());\n"
+"\n"
+"        // with -f, every int against a few constants\n"
+"        if (full) {\n"
+"                for (size_t i = 0; i < NTESTS; i++) {\n"
+"                        long c = tests[i].c;\n"
+"                        if (c != 3 && c != 7 && c != -7 && c != 10 &&\n"
+"                            c != 641 && c != 1000000007 && c != INT32_MIN)\n"
+"                                continue;\n"
+"                        for (long x = INT32_MIN; x <= INT32_MAX; x++)\n"
+"                                with(1, x, i);\n"
+"                }\n"
+"        }\n"
+"\n"
+"        printf(\"%ld results checked against %d constants, %ld wrong\\n\",\n"
+"               checked, (int)NTESTS, bad);\n"
+"        return bad != 0;\n"
+"}\n";
+
+// write C driver
+static void check(const std::string &path, const std::vector<long> &cs)
+{
+        auto fp = create(path);
+
+        fprintf(fp, "#include <stdint.h>\n"
+                    "#include <stdio.h>\n"
+                    "#include <string.h>\n"
+                    "\n"
+                    "extern unsigned char ac;\n"
+                    "extern int ai;\n"
+                    "extern long al;\n"
+                    "\n"
+                    "static const char *types[] = {\"char\", \"int\", "
+                        "\"long\"};\n"
+                    "\n");
+        for (size_t i = 0; i < cs.size(); i++) {
+                for (int t = 0; t < 3; t++)
+                        fprintf(fp, "long d%c_%zu(void), m%c_%zu(void);\n",
+                                        tchar[t], i, tchar[t], i);
+        }
+
+        fprintf(fp, "\n"
+                    "static const struct {\n"
+                    "        long c;\n"
+                    "        long (*div[3])(void);\n"
+                    "        long (*mul[3])(void);\n"
+                    "} tests[] = {\n");
+        for (size_t i = 0; i < cs.size(); i++) {
+                fprintf(fp, "        {%ldL, {dc_%zu, di_%zu, dl_%zu}, "
+                                "{mc_%zu, mi_%zu, ml_%zu}},\n",
+                                cs[i], i, i, i, i, i, i);
+        }
+        fprintf(fp, "};\n"
+                    "\n"
+                    "#define NTESTS (sizeof(tests) / sizeof(tests[0]))\n"
+                    "\n"
+                    "%s", driver);
+        finish(fp, path);
+}
+
+int main(int argc, char **argv)
+{
+        if (argc != 2 || argv[1][0] == '-')
+                usage_exit();
+
+        std::string path {argv[1]};
+        auto cs = constants();
+
+        try {
+                program(path + ".c", cs);
+                check(path + "-check.c", cs);
+        } catch (const CompileError &e) {
+                fprintf(stderr, "%s\n", e.what());
+                exit(EXIT_FAILURE);
+        }
+        return 0;
+}
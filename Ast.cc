@@ -1,4 +1,5 @@
 #include "Ast.h"
+#include "Mem.h"
 
 // check if ast type is valid
 //
@@ -36,106 +37,40 @@ static void typeok(int type)
         }
 }
 
-Ast::Ast(void)
-        : _left {nullptr},
-        _right {nullptr},
-        _mid {nullptr},
-        _type {AST_NONE},
-        _dtype {TYPE_NONE}
-{
-        _rval = 0;
-}
-
-Ast::Ast(int type, int dtype, Ast *left, Ast *right, int intlit)
+Ast::Ast(int type, int dtype, AstRef left, AstRef right, int val)
         : _left {left},
         _right {right},
-        _mid {nullptr},
-        _type {type},
-        _intlit {intlit},
-        _dtype {dtype}
-{
-        typeok(_type);
-        _rval = 0;
-}
-
-Ast::Ast(int type, int dtype, Ast *left, Ast *right, const std::string &id)
-        : _id {id},
-        _left {left},
-        _right {right},
-        _mid {nullptr},
-        _type {type},
-        _dtype {dtype}
-{
-        typeok(_type);
-        _rval = 0;
-}
-
-Ast::Ast(int type, int dtype, int intlit)
-        : _left {nullptr},
-        _right {nullptr},
-        _mid {nullptr},
-        _type {type},
-        _intlit {intlit},
-        _dtype {dtype}
+        _val {val},
+        _type {(uint8_t)type},
+        _dtype {(uint8_t)dtype},
+        _rval {0}
 {
-        typeok(_type);
-        _rval = 0;
+        typeok(type);
 }
 
-Ast::Ast(int type, int dtype, const std::string &id)
-        : _id {id},
-        _left {nullptr},
-        _right {nullptr},
-        _mid {nullptr},
-        _type {type},
-        _dtype {dtype}
-{
-        typeok(_type);
-        _rval = 0;
-}
-
-Ast::Ast(int type, int dtype, Ast *left, int intlit)
-        : _left {left},
-        _right {nullptr},
-        _mid {nullptr},
-        _type {type},
-        _intlit {intlit},
-        _dtype {dtype}
+AstRef Ast::Left(void) const
 {
-        typeok(_type);
-        _rval = 0;
-}
-
-Ast::Ast(int type, int dtype, Ast *left, const std::string &id)
-        : _id {id},
-        _left {left},
-        _right {nullptr},
-        _mid {nullptr},
-        _type {type},
-        _dtype {dtype}
-{
-        typeok(_type);
-        _rval = 0;
+        return _left;
 }
 
-Ast *Ast::Left(void) const
+AstRef Ast::Right(void) const
 {
-        return _left;
+        return _right;
 }
 
-Ast *Ast::Right(void) const
+AstRef Ast::Mid(void) const
 {
-        return _right;
+        return _type == AST_IF ? _val : NIL_AST;
 }
 
 int Ast::Int(void) const
 {
-        return _intlit;
+        return _val;
 }
 
-std::string Ast::Id(void) const
+SymRef Ast::Ref(void) const
 {
-        return _id;
+        return _val;
 }
 
 int Ast::Type(void) const
@@ -143,9 +78,9 @@ int Ast::Type(void) const
         return _type;
 }
 
-std::string Ast::Name(void) const
+std::string ast_name(int type)
 {
-        std::vector<std::string> names {
+        static const char *names[] = {
                 "AST_NONE",
                 "AST_ASSIGN",
                 "AST_ADD",
@@ -172,33 +107,13 @@ std::string Ast::Name(void) const
                 "AST_SCALE",
         };
 
-        return names[_type];
+        typeok(type);
+        return names[type];
 }
 
-void astfree(Ast *n)
-{
-        if (n == nullptr)
-                return;
-        astfree(n->Left());
-        astfree(n->Mid());
-        astfree(n->Right());
-        delete n;
-}
-
-Ast::Ast(int type, int dtype, Ast *left, Ast *mid, Ast *right, int intlit)
-        : _left {left},
-        _right {right},
-        _mid {mid},
-        _type {type},
-        _intlit {intlit},
-        _dtype {dtype}
-{
-        typeok(_type);
-}
-
-Ast *Ast::Mid(void) const
+std::string Ast::Name(void) const
 {
-        return _mid;
+        return ast_name(_type);
 }
 
 int Ast::Dtype(void) const
@@ -208,6 +123,7 @@ int Ast::Dtype(void) const
 
 void Ast::SetType(int type)
 {
+        typeok(type);
         _type = type;
 }
 
@@ -216,7 +132,7 @@ void Ast::SetDtype(int type)
         _dtype = type;
 }
 
-int Ast::Rval(void)
+int Ast::Rval(void) const
 {
         return _rval;
 }
@@ -226,12 +142,87 @@ void Ast::SetRval(int choice)
         _rval = choice;
 }
 
-int Ast::Size(void)
+void Ast::SetLeft(AstRef n)
 {
-        return _size;
+        _left = n;
 }
 
-void Ast::SetSize(int size)
+void Ast::SetRight(AstRef n)
 {
-        _size = size;
+        _right = n;
+}
+
+void Ast::SetMid(AstRef n)
+{
+        _val = n;
+}
+
+void Ast::SetInt(int v)
+{
+        _val = v;
+}
+
+AstPool::AstPool(void)
+        : _nodes {},
+        _peak {0},
+        _total {0}
+{
+        Reset();
+}
+
+AstRef AstPool::New(int type, int dtype, AstRef left, AstRef right, int val)
+{
+        MemTag mt {MEM_AST};
+
+        if (_nodes.size() > UINT32_MAX)
+                usage("too many ast nodes");
+
+        _nodes.emplace_back(type, dtype, left, right, val);
+        _total++;
+        return _nodes.size() - 1;
+}
+
+AstRef AstPool::NewIf(AstRef cond, AstRef truetree, AstRef falsetree)
+{
+        return New(AST_IF, TYPE_NONE, cond, falsetree, truetree);
+}
+
+Ast &AstPool::operator[](AstRef n)
+{
+        return _nodes[n];
+}
+
+const Ast &AstPool::operator[](AstRef n) const
+{
+        return _nodes[n];
+}
+
+size_t AstPool::Size(void) const
+{
+        return _nodes.size();
+}
+
+size_t AstPool::Total(void) const
+{
+        return _total;
+}
+
+void AstPool::Reset(void)
+{
+        MemTag mt {MEM_AST};
+
+        if (_nodes.size() > _peak)
+                _peak = _nodes.size();
+
+        _nodes.resize(1, Ast{AST_NONE, TYPE_NONE, NIL_AST, NIL_AST, 0});
+}
+
+void AstPool::Report(FILE *fp) const
+{
+        auto peak = _nodes.size() > _peak ? _nodes.size() : _peak;
+
+        fprintf(fp, "ast: %zu nodes, %zu bytes/node, "
+                        "peak %zu nodes in %zu bytes\n",
+                        _total, sizeof(Ast), peak,
+                        _nodes.capacity() * sizeof(Ast));
 }
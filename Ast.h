@@ -2,7 +2,11 @@
 #define AST_H
 
 #include "Error.h"
+#include "Intern.h"
+#include "Sym.h"
 #include "Type.h"
+#include <cstdint>
+#include <cstdio>
 #include <string>
 #include <vector>
 
@@ -34,80 +38,48 @@ enum {
         AST_SCALE,      // scale operation
 };
 
-// abstract syntax tree
+// index of node in an AstPool
+typedef uint32_t AstRef;
+
+// no node
+#define NIL_AST (AstRef)0
+
+// abstract syntax tree node
+//
+// children are indices into the AstPool that owns the node. AST_IF is
+// the only node with a middle child, and it has no other payload, so the
+// middle child is kept in _val
 class Ast {
 private:
-        std::string     _id;            // identifier value
-        Ast             *_left;         // left child
-        Ast             *_right;        // right child
-        Ast             *_mid;          // middle child
-        int             _type;          // ast type
-        int             _intlit;        // integer literal value
-        int             _dtype;         // data type of expression
-        int             _rval;          // are we an rvalue?
-        int             _size;          // size to scale by
+        AstRef          _left;          // left child
+        AstRef          _right;         // right child
+        int32_t         _val;           // integer literal, symbol,
+                                        // scale size or middle child
+        uint8_t         _type;          // ast type
+        uint8_t         _dtype;         // data type of expression
+        uint8_t         _rval;          // are we an rvalue?
 public:
-        // default constructor
-        Ast(void);
-
-        // @type:       ast type
-        // @dtype:      data type of expression
-        // @left:       left child
-        // @mid         middle child
-        // @right:      right child
-        // @intlit:     integer value
-        Ast(int type, int dtype, Ast *left, Ast *mid, Ast *right, int intlit);
-
-        // @type        ast type
-        // @dtype:      data type of expression
-        // @left:       left child
-        // @right:      right child
-        // @intlit:     integer literal
-        Ast(int type, int dtype, Ast *left, Ast *right, int intlit);
-
         // @type:       ast type
         // @dtype:      data type of expression
         // @left:       left child
         // @right:      right child
-        // @id:         identifier
-        Ast(int type, int dtype, Ast *left, Ast *right, const std::string &id);
-
-        // @type:       ast type
-        // @dtype:      data type of expression
-        // @intlit:     integer literal
-        Ast(int type, int dtype, int intlit);
-
-        // @type:       ast type
-        // @dtype:      data type of expression
-        // @id:         identifier
-        Ast(int type, int dtype, const std::string &id);
-
-        // @type:       ast type
-        // @dtype:      data type of expression
-        // @left        left child
-        // @intlit:     integer literal
-        Ast(int type, int dtype, Ast *left, int intlit);
-
-        // @type:       ast type
-        // @dtype:      data type of expression
-        // @left:       left child
-        // @id:         identifier
-        Ast(int type, int dtype, Ast *left, const std::string &id);
+        // @val:        integer literal, symbol or scale size
+        Ast(int type, int dtype, AstRef left, AstRef right, int val);
 
         // get left child
-        Ast *Left(void) const;
+        AstRef Left(void) const;
 
         // get right child
-        Ast *Right(void) const;
+        AstRef Right(void) const;
 
         // get middle child
-        Ast *Mid(void) const;
+        AstRef Mid(void) const;
 
         // get integer value
         int Int(void) const;
 
-        // get id value
-        std::string Id(void) const;
+        // get symbol of AST_IDENT, AST_ADDR, AST_CALL or AST_FUNC
+        SymRef Ref(void) const;
 
         // get ast type
         int Type(void) const;
@@ -121,18 +93,70 @@ public:
 
         void SetDtype(int type);
 
-        int Rval(void);
+        int Rval(void) const;
 
         void SetRval(int choice);
 
-        int Size(void);
+        // set left child
+        void SetLeft(AstRef n);
+
+        // set right child
+        void SetRight(AstRef n);
+
+        // set middle child of AST_IF
+        void SetMid(AstRef n);
+
+        // set integer value
+        void SetInt(int v);
+};
+
+// flat array of ast nodes
+//
+// node 0 is reserved so NIL_AST is never a real node. Reset() drops every
+// node but keeps the array, so after the first few functions no more
+// memory is allocated for nodes
+class AstPool {
+private:
+        std::vector<Ast>        _nodes; // nodes
+        size_t                  _peak;  // most nodes held at once
+        size_t                  _total; // nodes made since construction
+public:
+        // default constructor
+        AstPool(void);
+
+        // @type:       ast type
+        // @dtype:      data type of expression
+        // @left:       left child
+        // @right:      right child
+        // @val:        integer literal, symbol or scale size
+        AstRef New(int type, int dtype, AstRef left, AstRef right, int val);
+
+        // @cond:       condition
+        // @truetree:   taken when condition holds
+        // @falsetree:  else branch or NIL_AST
+        AstRef NewIf(AstRef cond, AstRef truetree, AstRef falsetree);
+
+        // get node
+        Ast &operator[](AstRef n);
+
+        const Ast &operator[](AstRef n) const;
+
+        // get number of nodes, counting NIL_AST
+        size_t Size(void) const;
+
+        // get number of nodes made since construction
+        size_t Total(void) const;
+
+        // drop all nodes
+        void Reset(void);
 
-        void SetSize(int size);
+        // print node count and memory use
+        void Report(FILE *fp) const;
 };
 
-// free ast
+// get ast type name
 //
-// @n:  pointer to Ast
-extern void astfree(Ast *n);
+// @type:       ast type
+extern std::string ast_name(int type);
 
 #endif
@@ -0,0 +1,506 @@
+#include "Cache.h"
+#include "Compiler.h"
+#include "Scan.h"
+#include "Synth.h"
+#include "SymTab.h"
+#include "Timer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// compile throughput benchmark
+//
+// writes a synthetic program of each size asked for and compiles it in
+// a child process of its own, so each size starts with a fresh interner
+// and its own peak RSS. the input is pretokenized so lexing is measured
+// on its own, and the times of the other phases come from the same
+// timers as --time-report
+//
+// with -l only the lexer runs, once with each scan code path the cpu
+// has, so the vector scans can be held up against the scalar one. with
+// -p the whole compile is timed by the wall clock, once lexing on the
+// parser thread as tokens are wanted and once with --pipeline lexing on
+// a thread of its own, which only pays off with a second core free.
+// with -c pct a rebuild is timed against a function cache: compiled
+// once with no cache, once into an empty one, once more unchanged, and
+// once with pct percent of the functions edited. with -g each size is
+// a number of globals put in a symbol table of their own, which is then
+// timed looking them up
+
+// times each lexer run is repeated, keeping the quickest
+#define LEX_RUNS        5
+
+// times each compile with -p is repeated, keeping the quickest
+#define PIPE_RUNS       3
+
+// lookups with -g, and how many names the hot ones are spread over
+#define SYM_LOOKUPS     10000000
+#define SYM_HOT         2048
+
+// scopes pushed and popped with -g, and names each one shadows
+#define SYM_SCOPES      100000
+#define SYM_SHADOW      16
+
+// results of compiling one program, sent back by the child
+struct Result {
+        SynthStats      src;    // program
+        size_t          toks;   // number of tokens
+        size_t          nodes;  // number of ast nodes
+        Times           t;      // time of each phase
+        long            lexrss; // peak RSS while lexing, in KB
+        long            rss;    // peak RSS while parsing and generating
+};
+
+static void usage_exit(void)
+{
+        fprintf(stderr, "mycc-bench [-d dir] [-s seed] [-l | -p | -c pct | -g] size[K|M|G]...\n");
+        exit(1);
+}
+
+// get wall clock time in ns
+static uint64_t now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// forget peak RSS so far, if the kernel lets us
+static void reset_peak(void)
+{
+        int fd = open("/proc/self/clear_refs", O_WRONLY);
+
+        if (fd < 0)
+                return;
+        // if this fails, peaks are since the child started
+        auto n = write(fd, "5", 1);
+        (void)n;
+        close(fd);
+}
+
+// get peak RSS in KB, or -1 if unknown
+static long peak_rss(void)
+{
+        auto fp = fopen("/proc/self/status", "r");
+        char line[256];
+        long kb {-1};
+
+        if (fp == nullptr)
+                return -1;
+        while (fgets(line, sizeof(line), fp) != nullptr) {
+                if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+                        break;
+        }
+        fclose(fp);
+        return kb;
+}
+
+// compile program in path and fill in everything but r.src
+static void run(const std::string &path, Result &r)
+{
+        timereport.Enable();
+        Compiler c {path, path + ".s"};
+
+        reset_peak();
+        c.Lex().Tokenize();
+        r.lexrss = peak_rss();
+        r.toks = c.Lex().Toks().Size();
+
+        reset_peak();
+        c.Run();
+        r.rss = peak_rss();
+        r.nodes = c.Nodes().Total();
+        r.t = timereport.Totals();
+}
+
+// compile program in path in a child process
+static int bench(const std::string &path, Result &r)
+{
+        int fd[2];
+
+        if (pipe(fd) < 0)
+                error("could not make pipe");
+
+        auto pid = fork();
+        if (pid < 0)
+                error("could not fork");
+        if (pid == 0) {
+                close(fd[0]);
+                try {
+                        run(path, r);
+                } catch (const CompileError &e) {
+                        fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+                        _exit(1);
+                }
+                if (write(fd[1], &r, sizeof(r)) != sizeof(r))
+                        _exit(1);
+                _exit(0);
+        }
+
+        close(fd[1]);
+        auto n = read(fd[0], &r, sizeof(r));
+        close(fd[0]);
+
+        int status;
+        if (waitpid(pid, &status, 0) < 0)
+                error("could not wait for child");
+        return n == sizeof(r) && WIFEXITED(status) &&
+                WEXITSTATUS(status) == 0;
+}
+
+// print rate of n things in ns nanoseconds, in millions per second
+static void rate(size_t n, uint64_t ns)
+{
+        if (ns == 0)
+                printf(" %10s", "-");
+        else
+                printf(" %10.2f", n * 1e3 / ns);
+}
+
+static void report(const char *size, const Result &r)
+{
+        static const char *names[NPHASES] = {
+                "total", "lex", "parse", "type", "gen", "write",
+        };
+        uint64_t total {0};
+
+        for (int i = 1; i < NPHASES; i++)
+                total += r.t.wall[i];
+
+        for (int i = 1; i <= NPHASES; i++) {
+                // total last
+                auto p = i % NPHASES;
+                auto ns = p ? r.t.wall[p] : total;
+                auto rss = p == PHASE_LEX ? r.lexrss :
+                        p ? r.rss : std::max(r.lexrss, r.rss);
+
+                printf("%-8s %-6s %10.2f", i == 1 ? size : "", names[p],
+                                ns / 1e6);
+                rate(r.src.lines, ns);
+                rate(r.toks, ns);
+                rate(r.nodes, ns);
+                printf(" %9.1f\n", rss / 1024.0);
+        }
+}
+
+// lex program in path with each scan code path
+static void lexbench(const char *size, const std::string &path,
+                const SynthStats &src)
+{
+        static const char *names[] = {"scalar", "sse2", "avx2"};
+
+        for (int isa = SCAN_SCALAR; isa <= SCAN_AVX2; isa++) {
+                if (scan_limit(isa) != isa)
+                        continue;
+
+                uint64_t best {UINT64_MAX};
+                size_t toks {0};
+                // the first run interns every identifier, so it is not
+                // kept
+                for (int i = 0; i <= LEX_RUNS; i++) {
+                        Lexer lex {path};
+                        auto t = now();
+                        lex.Tokenize();
+                        t = now() - t;
+                        if (i)
+                                best = std::min(best, t);
+                        toks = lex.Toks().Size();
+                }
+
+                printf("%-8s %-6s %10.2f", isa ? "" : size, names[isa],
+                                best / 1e6);
+                rate(src.bytes, best);
+                rate(toks, best);
+                printf("\n");
+        }
+        scan_limit(SCAN_AVX2);
+}
+
+// compile program in path serially and pipelined, in wall clock time
+static void pipebench(const char *size, const std::string &path,
+                const SynthStats &src)
+{
+        static const char *names[] = {"serial", "pipe"};
+        uint64_t best[2] {UINT64_MAX, UINT64_MAX};
+
+        // the first compile interns every identifier, so it is not kept;
+        // the modes take turns so neither gets a warmer cache
+        for (int i = 0; i <= PIPE_RUNS; i++) {
+                for (int m = 0; m < 2; m++) {
+                        Compiler c {path, path + ".s"};
+                        auto t = now();
+                        if (m)
+                                c.Lex().Pipeline();
+                        c.Run();
+                        t = now() - t;
+                        if (i)
+                                best[m] = std::min(best[m], t);
+                }
+        }
+
+        for (int m = 0; m < 2; m++) {
+                printf("%-8s %-6s %10.2f", m ? "" : size, names[m],
+                                best[m] / 1e6);
+                rate(src.lines, best[m]);
+                printf(" %9.2fx\n", (double)best[0] / best[m]);
+        }
+}
+
+// copy program, adding an if to pct percent of its functions, spread
+// evenly. the if adds labels, so the label numbers of every function
+// after an edited one move too. returns the number of functions edited
+static size_t edit(const std::string &in, const std::string &out, int pct)
+{
+        auto ifp = fopen(in.c_str(), "r");
+        if (ifp == nullptr)
+                error("could not open %s", in.c_str());
+        auto ofp = fopen(out.c_str(), "w");
+        if (ofp == nullptr)
+                error("could not open %s", out.c_str());
+
+        char line[4096];
+        char fn[64] {};
+        size_t funcs {0};
+        size_t edited {0};
+
+        while (fgets(line, sizeof(line), ifp) != nullptr) {
+                // functions end in the one return at depth 1
+                if (sscanf(line, "long fn_%60[0-9]()", fn) == 1) {
+                        funcs++;
+                } else if (strncmp(line, "\treturn (", 9) == 0 &&
+                           (funcs - 1) * pct % 100 < (size_t)pct) {
+                        fprintf(ofp, "\tif (a_%s < 1) {\n"
+                                        "\t\ta_%s = 1;\n"
+                                        "\t}\n", fn, fn);
+                        edited++;
+                }
+                fputs(line, ofp);
+        }
+
+        fclose(ifp);
+        if (fclose(ofp) == EOF)
+                error("could not write %s", out.c_str());
+        return edited;
+}
+
+// compile program in path against cache in dir, or with no cache if dir
+// is empty, and print how long it took
+static void cacherun(const char *size, const char *name,
+                const std::string &path, const std::string &dir)
+{
+        std::unique_ptr<Cache> cache;
+        auto t = now();
+
+        if (!dir.empty())
+                cache.reset(new Cache{dir});
+        Compiler c {path, path + ".s"};
+        if (cache)
+                c.Gen().SetCache(cache.get());
+        c.Run();
+        if (cache)
+                cache->Save();
+        t = now() - t;
+
+        printf("%-8s %-10s %10.2f", size, name, t / 1e6);
+        if (cache)
+                printf(" %10zu %10zu\n", cache->Hits(), cache->Misses());
+        else
+                printf(" %10s %10s\n", "-", "-");
+}
+
+// compile program in path without and with a cache, then again with pct
+// percent of its functions edited
+static void cachebench(const char *size, const std::string &path,
+                const std::string &dir, int pct)
+{
+        auto cdir = dir + "/mycc-bench-cache";
+        auto epath = path + ".edit.c";
+
+        auto n = edit(path, epath, pct);
+        unlink((cdir + "/pack").c_str());
+
+        // the first compile interns every identifier, so it is not shown
+        {
+                Compiler c {path, path + ".s"};
+                c.Run();
+        }
+        cacherun(size, "none", path, "");
+        cacherun("", "cold", path, cdir);
+        cacherun("", "warm", path, cdir);
+        cacherun("", ("edit " + std::to_string(n)).c_str(), epath, cdir);
+
+        unlink((cdir + "/pack").c_str());
+        rmdir(cdir.c_str());
+        unlink(epath.c_str());
+        unlink((epath + ".s").c_str());
+}
+
+// print time of n symbol table operations
+static void symrow(const char *size, const char *op, size_t n, uint64_t ns)
+{
+        printf("%-8s %-8s %10zu %10.2f", size, op, n, ns / 1e6);
+        rate(n, ns);
+        printf("\n");
+}
+
+// declare n globals and look them up
+static void symbench(const char *size, size_t n)
+{
+        std::vector<Ident> ids;
+        uint64_t rng {88172645463325252ull};
+        size_t sum {0};
+        SymTab tab;
+
+        // names are interned before the clock starts, as the lexer would
+        for (size_t i = 0; i < n; i++)
+                ids.push_back(interner.Intern("g_" + std::to_string(i)));
+
+        auto t = now();
+        for (auto id : ids)
+                tab.Set(id, Sym{TYPE_LONG, STYPE_VAR, 0, id});
+        symrow(size, "insert", n, now() - t);
+
+        // xorshift, so picking a name costs next to nothing
+        auto next = [&rng]() {
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                return rng;
+        };
+
+        t = now();
+        for (size_t i = 0; i < SYM_LOOKUPS; i++)
+                sum += tab.Get(ids[next() % n])->Prim();
+        symrow("", "random", SYM_LOOKUPS, now() - t);
+
+        auto hot = std::min(n, (size_t)SYM_HOT);
+        t = now();
+        for (size_t i = 0; i < SYM_LOOKUPS; i++)
+                sum += tab.Get(ids[next() % hot])->Prim();
+        symrow("", "hot", SYM_LOOKUPS, now() - t);
+
+        t = now();
+        for (size_t i = 0; i < SYM_SCOPES; i++) {
+                tab.Push();
+                for (size_t j = 0; j < SYM_SHADOW; j++) {
+                        auto id = ids[next() % n];
+                        // a name may come up twice in one scope
+                        if (tab.Get(id)->Prim() == TYPE_LONG)
+                                tab.Set(id, Sym{TYPE_INT, STYPE_VAR, 0, id});
+                }
+                tab.Pop();
+        }
+        symrow("", "scope", SYM_SCOPES, now() - t);
+
+        // keep the lookups from being optimized out
+        if (sum == 0)
+                printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+        std::string dir {"/tmp"};
+        uint64_t seed {1};
+        int lexonly {0};
+        int pipelined {0};
+        int pct {0};
+        int syms {0};
+        int c;
+
+        while ((c = getopt(argc, argv, "d:s:lpc:g")) != -1) {
+                switch (c) {
+                case 'd':
+                        dir = optarg;
+                        break;
+                case 'l':
+                        lexonly = 1;
+                        break;
+                case 'p':
+                        pipelined = 1;
+                        break;
+                case 'c':
+                        pct = atoi(optarg);
+                        if (pct <= 0 || pct > 100)
+                                usage_exit();
+                        break;
+                case 'g':
+                        syms = 1;
+                        break;
+                case 's':
+                        seed = strtoull(optarg, nullptr, 10);
+                        break;
+                default:
+                        usage_exit();
+                }
+        }
+        if (optind == argc || lexonly + pipelined + !!pct + syms > 1)
+                usage_exit();
+
+        int failed {0};
+
+        if (syms)
+                printf("%-8s %-8s %10s %10s %10s\n", "globals", "op",
+                                "count", "ms", "M/s");
+        else if (pct)
+                printf("%-8s %-10s %10s %10s %10s\n", "size", "cache", "ms",
+                                "hits", "misses");
+        else if (pipelined)
+                printf("%u cores\n%-8s %-6s %10s %10s %10s\n",
+                                std::thread::hardware_concurrency(), "size",
+                                "lexer", "ms", "Mlines/s", "speedup");
+        else if (lexonly)
+                printf("%-8s %-6s %10s %10s %10s\n", "size", "scan", "ms",
+                                "MB/s", "Mtoks/s");
+        else
+                printf("%-8s %-6s %10s %10s %10s %10s %9s\n", "size",
+                                "phase", "ms", "Mlines/s", "Mtoks/s",
+                                "Mnodes/s", "peak MB");
+
+        for (int i = optind; i < argc; i++) {
+                auto size = parse_size(argv[i]);
+                if (size == 0)
+                        usage_exit();
+                if (syms) {
+                        symbench(argv[i], size);
+                        fflush(stdout);
+                        continue;
+                }
+
+                auto path = dir + "/mycc-bench-" + argv[i] + ".c";
+                Result r {};
+                try {
+                        auto fp = fopen(path.c_str(), "w");
+                        if (fp == nullptr)
+                                error("could not open %s", path.c_str());
+                        r.src = Synth{fp, seed}.Write(size);
+                        if (fclose(fp) == EOF)
+                                error("could not write %s", path.c_str());
+
+                        if (pct)
+                                cachebench(argv[i], path, dir, pct);
+                        else if (pipelined)
+                                pipebench(argv[i], path, r.src);
+                        else if (lexonly)
+                                lexbench(argv[i], path, r.src);
+                        else if (bench(path, r))
+                                report(argv[i], r);
+                        else
+                                failed = 1;
+                } catch (const CompileError &e) {
+                        fprintf(stderr, "%s\n", e.what());
+                        failed = 1;
+                }
+                unlink(path.c_str());
+                unlink((path + ".s").c_str());
+                fflush(stdout);
+        }
+
+        return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,169 @@
+#include "Cache.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// entry: magic, fixup count, code length, key, fixups, code without
+// label numbers
+static constexpr uint32_t MAGIC = 0x3143594d;   // "MYC1"
+static constexpr size_t HDR = 12 + sizeof(Digest);
+
+Cache::Cache(const std::string &dir)
+        : _path {dir + "/pack"},
+        _pack {},
+        _index {},
+        _lock {},
+        _new {},
+        _hits {0},
+        _misses {0},
+        _stores {0}
+{
+        if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+                error("could not make cache directory %s", dir.c_str());
+
+        if (access(_path.c_str(), F_OK) == 0) {
+                _pack.reset(new Source{_path});
+                load();
+        }
+}
+
+void Cache::load(void)
+{
+        auto p = _pack->Buf();
+        auto end = p + _pack->Len();
+        uint32_t hdr[3];
+        Digest key;
+
+        while ((size_t)(end - p) >= HDR) {
+                memcpy(hdr, p, sizeof(hdr));
+                memcpy(&key, p + 12, sizeof(key));
+
+                auto size = HDR + (size_t)hdr[1] * sizeof(Fixup) + hdr[2];
+                if (hdr[0] != MAGIC || (size_t)(end - p) < size)
+                        break;
+
+                _index.insert({key, p});
+                p += size;
+        }
+}
+
+int Cache::Get(const Digest &key, int base, Emit &out)
+{
+        auto e = _index.find(key);
+
+        if (e == _index.end()) {
+                _misses++;
+                return 0;
+        }
+
+        uint32_t hdr[3];
+        memcpy(hdr, e->second, sizeof(hdr));
+
+        auto fix = e->second + HDR;
+        auto code = fix + hdr[1] * sizeof(Fixup);
+        size_t off {0};
+        Fixup f;
+
+        for (uint32_t i = 0; i < hdr[1]; i++, off = f.off) {
+                memcpy(&f, fix + i * sizeof(Fixup), sizeof(f));
+                out.Put(code + off, f.off - off);
+                out << (long)base + f.rel;
+        }
+        out.Put(code + off, hdr[2] - off);
+
+        _hits++;
+        return 1;
+}
+
+void Cache::Put(const Digest &key, const Emit &code,
+                const std::vector<Fixup> &fix)
+{
+        uint32_t hdr[3] = {MAGIC, (uint32_t)fix.size(), 0};
+        auto nfix = fix.size();
+        std::vector<char> e(HDR + nfix * sizeof(Fixup));
+        auto text = code.Data();
+        size_t off {0};
+
+        // cut out label numbers, moving each fixup to the stripped code
+        for (size_t i = 0; i < nfix; i++) {
+                auto end = fix[i].off;
+                e.insert(e.end(), text + off, text + end);
+                while (end < code.Size() && text[end] >= '0' &&
+                                text[end] <= '9')
+                        end++;
+
+                Fixup f {(uint32_t)(e.size() - HDR - nfix * sizeof(Fixup)),
+                        fix[i].rel};
+                memcpy(e.data() + HDR + i * sizeof(Fixup), &f, sizeof(f));
+                off = end;
+        }
+        e.insert(e.end(), text + off, text + code.Size());
+
+        hdr[2] = e.size() - HDR - nfix * sizeof(Fixup);
+        memcpy(e.data(), hdr, sizeof(hdr));
+        memcpy(e.data() + 12, &key, sizeof(key));
+
+        std::lock_guard<std::mutex> guard {_lock};
+        _new.insert(_new.end(), e.begin(), e.end());
+        _stores++;
+}
+
+void Cache::Save(void)
+{
+        std::lock_guard<std::mutex> guard {_lock};
+        size_t off {0};
+        int fd;
+
+        if (_new.empty())
+                return;
+
+        if ((fd = open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND,
+                                        0644)) < 0)
+                error("could not open %s", _path.c_str());
+
+        // other compilers may be saving to the same pack
+        if (flock(fd, LOCK_EX) < 0) {
+                close(fd);
+                error("could not lock %s", _path.c_str());
+        }
+
+        while (off < _new.size()) {
+                auto n = write(fd, _new.data() + off, _new.size() - off);
+                if (n < 0 && errno == EINTR)
+                        continue;
+                if (n < 0) {
+                        close(fd);
+                        error("could not write %s", _path.c_str());
+                }
+                off += n;
+        }
+
+        close(fd);
+        _new.clear();
+}
+
+void Cache::Report(FILE *fp) const
+{
+        fprintf(fp, "cache: %zu hits, %zu misses, %zu stored\n",
+                        _hits.load(), _misses.load(), _stores.load());
+}
+
+size_t Cache::Hits(void) const
+{
+        return _hits.load();
+}
+
+size_t Cache::Misses(void) const
+{
+        return _misses.load();
+}
+
+Cache::~Cache()
+{
+        // a destructor must not throw; callers who care use Save()
+        try {
+                Save();
+        } catch (const CompileError &) {
+        }
+}
@@ -0,0 +1,102 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "Emit.h"
+#include "Error.h"
+#include "Hash.h"
+#include "Source.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// label number written at an offset of a function's code
+struct Fixup {
+        uint32_t        off;    // offset of number in code
+        int32_t         rel;    // label relative to function's first label
+};
+
+// on-disk cache of generated functions
+//
+// an entry is keyed by a digest of the function's tokens and of the
+// symbols it refers to. it holds the function's assembly with label
+// numbers cut out, so it can be spliced in wherever the function's
+// labels happen to start.
+//
+// entries live in one pack file per cache directory. the pack is mapped
+// and indexed once, so a lookup costs a hash probe and a copy rather
+// than a file open; entries stored during a run are appended to the pack
+// by Save(). one Cache may serve many compilations at once
+class Cache {
+private:
+        // hash a digest for the index; it is already well mixed
+        struct DigestHash {
+                size_t operator()(const Digest &d) const
+                {
+                        return d.lo;
+                }
+        };
+
+        // compare digests for the index
+        struct DigestEq {
+                bool operator()(const Digest &a, const Digest &b) const
+                {
+                        return a.lo == b.lo && a.hi == b.hi;
+                }
+        };
+
+        std::string             _path;          // path name of pack
+        std::unique_ptr<Source> _pack;          // pack as read at start
+        std::unordered_map<Digest,const char*,DigestHash,DigestEq> _index;
+                                                // key -> entry in _pack
+        std::mutex              _lock;          // guards _new
+        std::vector<char>       _new;           // entries stored this run
+        std::atomic<size_t>     _hits;          // entries found
+        std::atomic<size_t>     _misses;        // entries not found
+        std::atomic<size_t>     _stores;        // entries stored
+
+        // index entries of pack, stopping at a damaged one
+        void load(void);
+public:
+        // @dir:        cache directory, made if missing
+        Cache(const std::string &dir);
+
+        Cache(const Cache &) = delete;
+        Cache &operator=(const Cache &) = delete;
+
+        // look up function and append its code to out
+        //
+        // @key:        digest of function
+        // @base:       first label of function
+        // @out:        output
+        // @return:     1 on hit, 0 on miss
+        int Get(const Digest &key, int base, Emit &out);
+
+        // store function
+        //
+        // @key:        digest of function
+        // @code:       generated code
+        // @fix:        label numbers in code, in order
+        void Put(const Digest &key, const Emit &code,
+                        const std::vector<Fixup> &fix);
+
+        // append entries stored so far to pack
+        void Save(void);
+
+        // print hit and miss counts
+        void Report(FILE *fp) const;
+
+        // get number of entries found
+        size_t Hits(void) const;
+
+        // get number of entries not found
+        size_t Misses(void) const;
+
+        // saves, ignoring errors
+        ~Cache();
+};
+
+#endif
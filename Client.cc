@@ -0,0 +1,108 @@
+#include "Error.h"
+#include "Wire.h"
+#include <climits>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// thin client for the compile server: sends input, writes out.s
+
+static void usage_exit(void)
+{
+        fprintf(stderr, "mycc-client [--path] socket input\n");
+        exit(1);
+}
+
+// read whole file
+static std::string slurp(const char *path)
+{
+        std::string s;
+        char buf[1 << 16];
+        ssize_t got;
+        int fd;
+
+        if ((fd = open(path, O_RDONLY)) < 0)
+                error("could not open: %s", path);
+
+        for (;;) {
+                got = read(fd, buf, sizeof(buf));
+                if (got < 0 && errno == EINTR)
+                        continue;
+                if (got < 0)
+                        error("could not read: %s", path);
+                if (got == 0)
+                        break;
+                s.append(buf, got);
+        }
+
+        close(fd);
+        return s;
+}
+
+static int run(int argc, char **argv)
+{
+        struct sockaddr_un addr {};
+        std::string body;
+        int sendpath {0};
+        int kind;
+        int fd;
+
+        if (argc > 1 && !strcmp(argv[1], "--path")) {
+                sendpath = 1;
+                argv++;
+                argc--;
+        }
+        if (argc != 3 || strlen(argv[1]) >= sizeof(addr.sun_path))
+                usage_exit();
+
+        if (sendpath) {
+                char abs[PATH_MAX];
+                if (!realpath(argv[2], abs))
+                        error("could not resolve: %s", argv[2]);
+                body = abs;
+        } else {
+                body = slurp(argv[2]);
+        }
+
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+                error("could not create socket");
+
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, argv[1]);
+        if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                                sizeof(addr)) < 0)
+                error("could not connect to %s", argv[1]);
+
+        if (write_msg(fd, sendpath ? MSG_PATH : MSG_SOURCE, body.data(),
+                                body.size()) < 0)
+                error("could not send request");
+        if (read_msg(fd, kind, body, body.max_size()) <= 0)
+                error("could not read reply");
+        close(fd);
+
+        if (kind != MSG_ASM) {
+                fprintf(stderr, "%s\n", body.c_str());
+                exit(1);
+        }
+
+        if ((fd = open("out.s", O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+                error("could not open out.s");
+        if (write(fd, body.data(), body.size()) != (ssize_t)body.size())
+                error("could not write out.s");
+        close(fd);
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        try {
+                return run(argc, argv);
+        } catch (const CompileError &e) {
+                fprintf(stderr, "%s\n", e.what());
+                return 1;
+        }
+}
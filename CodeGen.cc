@@ -1,15 +1,73 @@
 #include "CodeGen.h"
+#include "Mem.h"
 #include "Parser.h"
 
 CodeGen::CodeGen(const std::string &path)
         : _path {path},
-        _stk {},
-        _tab {},
-        _fp {fopen(path.c_str(), "w")},
-        _id {1}
+        _regs {},
+        _owntab {},
+        _tab (_owntab),
+        _file {path},
+        _out {&_file},
+        _body {},
+        _peep {},
+        _asm {},
+        _id {1},
+        _ast {nullptr},
+        _func {nullptr},
+        _pool {},
+        _jobs {},
+        _cache {nullptr},
+        _fixups {nullptr},
+        _base {0},
+        _opt {1}
+{}
+
+CodeGen::CodeGen(void)
+        : _path {},
+        _regs {},
+        _owntab {},
+        _tab (_owntab),
+        _file {},
+        _out {&_file},
+        _body {},
+        _peep {},
+        _asm {},
+        _id {1},
+        _ast {nullptr},
+        _func {nullptr},
+        _pool {},
+        _jobs {},
+        _cache {nullptr},
+        _fixups {nullptr},
+        _base {0},
+        _opt {1}
+{}
+
+CodeGen::CodeGen(SymTab &tab, Emit &out, int label)
+        : _path {},
+        _regs {},
+        _owntab {},
+        _tab (tab),
+        _file {},
+        _out {&out},
+        _body {},
+        _peep {},
+        _asm {},
+        _id {label},
+        _ast {nullptr},
+        _func {nullptr},
+        _pool {},
+        _jobs {},
+        _cache {nullptr},
+        _fixups {nullptr},
+        _base {label},
+        _opt {1}
+{}
+
+void CodeGen::Parallel(size_t n)
 {
-        if (_fp == nullptr)
-                error("could not open %s", path.c_str());
+        _pool.reset(new Pool{n});
 }
 
 int CodeGen::GetLabel(void)
@@ -17,115 +75,402 @@ int CodeGen::GetLabel(void)
         return _id++;
 }
 
-CodeGen::~CodeGen()
-{
-        if (fclose(_fp) < 0)
-                error("could not close %s", _path.c_str());
-}
-
 void CodeGen::GenPre(void)
 {
-        Free();
-        fputs("\t.text\n", _fp);
+        MemTag mt {MEM_GEN};
+
+        *_out << "\t.text\n";
 }
 
-void CodeGen::GenPost(const std::string& id)
+void CodeGen::GenPost(const Sym *s)
 {
-        auto s = _tab.Get(id);
         label(s->End());
-        fputs("\tpopq   %rbp\n"
-              "\tret\n",
-              _fp);
+        _regs.Leave(*_out);
+        *_out << "\tpopq   %rbp\n"
+                "\tret\n";
 }
 
 void CodeGen::GenPrintInt(size_t r)
 {
-        fprintf(_fp, "\tmovq\t%s, %%rdi\n", _stk.Name(r));
-        fprintf(_fp, "\tcall\tprintint\n");
-        _stk.Put(r);
+        clobber(REG_BIT(GPR_RDI));
+        *_out << "\tmovq\t" << _regs.Name(r) << ", %rdi\n";
+        clobber(REGS_CALLER);
+        *_out << "\tcall\tprintint\n";
 }
 
-void CodeGen::GenGlo(const std::string &id)
+void CodeGen::GenGlo(const Sym *s)
 {
-        auto s = _tab.Get(id);
+        if (!_jobs.empty()) {
+                // keep the variable behind functions still being generated
+                std::unique_ptr<Job> job {new Job{}};
+                CodeGen{_tab, job->out, 0}.GenGlo(s);
+                job->done.store(1, std::memory_order_relaxed);
+                _jobs.push_back(std::move(job));
+                return;
+        }
+
         int size = PrimSize(s->Prim());
+        auto name = interner.Name(s->Name());
 
-        fprintf(_fp, "\t.data\n");
-        fprintf(_fp, "\t.globl\t%s\n", id.c_str());
+        *_out << "\t.data\n"
+                "\t.globl\t" << name << "\n";
+
+        if (s->Stype() == STYPE_ARR) {
+                *_out << name << ":\t.zero\t"
+                        << (long)PrimSize(val_at(s->Prim())) * s->Size()
+                        << "\n";
+                return;
+        }
 
         switch (size) {
         case 1:
-                fprintf(_fp, "%s:\t.byte\t0\n", id.c_str());
+                *_out << name << ":\t.byte\t0\n";
                 break;
         case 4:
-                fprintf(_fp, "%s:\t.long\t0\n", id.c_str());
+                *_out << name << ":\t.long\t0\n";
                 break;
         case 8:
-                fprintf(_fp, "%s:\t.quad\t0\n", id.c_str());
+                *_out << name << ":\t.quad\t0\n";
                 break;
         default:
                 usage("unknown type size: %d", size);
         }
 }
 
-size_t CodeGen::genIfAst(Ast *n)
+size_t CodeGen::genIfAst(AstRef n)
 {
+        auto &a = node(n);
         int falseid;
         int endid;
 
         falseid = GetLabel();
-        if (n->Right())
+        if (a.Right())
                 endid = GetLabel();
 
-        GenAst(n->Left(), (size_t)falseid, n->Type());
-        Free();
+        GenAst(a.Left(), (size_t)falseid, a.Type());
 
-        GenAst(n->Mid(), NIL_REG, n->Type());
-        Free();
+        GenAst(a.Mid(), NIL_REG, a.Type());
 
-        if (n->Right())
+        if (a.Right())
                 jmp(endid);
 
         label(falseid);
 
-        if (n->Right()) {
-                GenAst(n->Right(), NIL_REG, n->Type());
-                Free();
+        if (a.Right()) {
+                GenAst(a.Right(), NIL_REG, a.Type());
                 label(endid);
         }
 
         return NIL_REG;
 }
 
-size_t CodeGen::GenAst(Ast *n, size_t r, int parentop)
+size_t CodeGen::genFunc(AstRef n)
 {
+        auto &a = node(n);
+        auto out = _out;
+        auto nfix = _fixups ? _fixups->size() : 0;
+
+        _func = _tab.At(a.Ref());
+        TraceSpan ts {"gen", interner.Name(_func->Name())};
+
+        // generate the body with virtual registers, then give them real
+        // ones; the frame is only known after that
+        _regs.Start();
+        _regs.Reserve(_func->Frame());
+        _body.Clear();
+        _out = &_body;
+        GenAst(a.Left(), NIL_REG, a.Type());
+        _out = out;
+        _regs.Alloc(_body, _opt >= 2 ? RA_COLOR : RA_LINEAR);
+
+        // with optimization on, the whole function goes through the
+        // peephole optimizer before the output
+        if (_opt > 0) {
+                _asm.Clear();
+                _out = &_asm;
+        }
+        funcPre(_func);
+        _regs.Rewrite(_body, *_out);
+        if (_fixups) {
+                for (auto i = nfix; i < _fixups->size(); i++) {
+                        auto &f = (*_fixups)[i];
+                        f.off = _regs.Map(f.off);
+                }
+        }
+        funcPost(_func);
+        if (_opt == 0)
+                return NIL_REG;
+
+        _out = out;
+        _peep.Run(_asm, *_out);
+        if (_fixups) {
+                auto j = nfix;
+                for (auto i = nfix; i < _fixups->size(); i++) {
+                        auto f = (*_fixups)[i];
+                        auto off = _peep.Map(f.off);
+                        if (off == SIZE_MAX)
+                                continue;
+                        f.off = off;
+                        (*_fixups)[j++] = f;
+                }
+                _fixups->resize(j);
+        }
+        return NIL_REG;
+}
+
+void CodeGen::clobber(uint32_t regs)
+{
+        _regs.Clobber(_out->Size(), regs);
+}
+
+const Ast &CodeGen::node(AstRef n) const
+{
+        return (*_ast)[n];
+}
+
+void CodeGen::GenFunc(const AstPool &ast, AstRef n, const Digest &toks)
+{
+        PhaseTimer pt {PHASE_GEN};
+        MemTag mt {MEM_GEN};
+
+        if (!_pool && !_cache) {
+                _ast = &ast;
+                GenAst(n, NIL_REG, 0);
+                _ast = nullptr;
+                return;
+        }
+
+        std::unique_ptr<Job> job {new Job{}};
+        auto nlabels = countLabels(ast, n);
+        auto p = job.get();
+
+        job->root = n;
+        job->label = _id;
+        job->time = timed_func();
+        _id += nlabels;
+        // with nothing queued before it, a cached function goes straight
+        // into the output
+        int hit {0};
+        if (_cache) {
+                job->key = funcKey(ast, toks);
+                hit = _cache->Get(job->key, job->label,
+                                _jobs.empty() ? *_out : job->out);
+                if (hit && _jobs.empty())
+                        return;
+        }
+        _jobs.push_back(std::move(job));
+
+        if (hit) {
+                p->done.store(1, std::memory_order_relaxed);
+        } else if (_pool) {
+                {
+                        MemTag ast_mt {MEM_AST};
+                        p->ast = ast;
+                }
+                _pool->Submit([this, p, nlabels]() {
+                        runJob(p, p->ast, nlabels);
+                });
+        } else {
+                runJob(p, ast, nlabels);
+        }
+        drain(0);
+}
+
+Digest CodeGen::funcKey(const AstPool &ast, const Digest &toks)
+{
+        Hasher h;
+
+        h.Add(CACHE_VERSION);
+        h.Add((uint64_t)_opt);
+        h.Add(toks.lo);
+        h.Add(toks.hi);
+
+        // the code also depends on the types of the symbols used
+        for (AstRef i = 1; i < ast.Size(); i++) {
+                switch (ast[i].Type()) {
+                case AST_IDENT:
+                case AST_FUNC:
+                case AST_CALL:
+                case AST_ADDR: {
+                        auto s = _tab.At(ast[i].Ref());
+                        auto id = s->Name();
+                        h.Add(interner.Name(id), interner.Len(id));
+                        h.Add((uint64_t)s->Prim());
+                        h.Add((uint64_t)s->Stype());
+                        h.Add((uint64_t)s->Off());
+                        break;
+                }
+                }
+        }
+
+        return h.Sum();
+}
+
+int CodeGen::countLabels(const AstPool &ast, AstRef n) const
+{
+        if (n == NIL_AST)
+                return 0;
+
+        auto &a = ast[n];
+
+        switch (a.Type()) {
+        case AST_IF:
+                return 1 + (a.Right() != NIL_AST) +
+                        countLabels(ast, a.Left()) +
+                        countLabels(ast, a.Mid()) +
+                        countLabels(ast, a.Right());
+        case AST_WHILE:
+                return 2 + countLabels(ast, a.Left()) +
+                        countLabels(ast, a.Right());
+        default:
+                return countLabels(ast, a.Left()) +
+                        countLabels(ast, a.Right());
+        }
+}
+
+void CodeGen::runJob(Job *job, const AstPool &ast, int nlabels)
+{
+        FuncTimer ft {job->time};
+        PhaseTimer pt {PHASE_GEN};
+        CodeGen cg {_tab, job->out, job->label};
+
+        cg._opt = _opt;
+        if (_cache)
+                cg._fixups = &job->fixups;
+
+        // the error is raised again in order when the job is written out
+        try {
+                cg.GenFunc(ast, job->root, Digest{});
+                if (cg._id != job->label + nlabels)
+                        usage("function used %d labels, expected %d",
+                                        cg._id - job->label, nlabels);
+                if (_cache)
+                        _cache->Put(job->key, job->out, job->fixups);
+        } catch (const CompileError &e) {
+                job->err = e.what();
+        }
+        job->done.store(1, std::memory_order_release);
+}
+
+void CodeGen::drain(int wait)
+{
+        PhaseTimer pt {PHASE_WRITE};
+        MemTag mt {MEM_GEN};
+
+        if (wait && _pool)
+                _pool->Wait();
+
+        while (!_jobs.empty()) {
+                auto &job = _jobs.front();
+                if (!job->done.load(std::memory_order_acquire))
+                        break;
+                if (!job->err.empty())
+                        throw CompileError{job->err};
+                _out->Put(job->out);
+                _jobs.pop_front();
+        }
+}
+
+void CodeGen::Finish(void)
+{
+        TraceSpan ts {"write"};
+        PhaseTimer pt {PHASE_WRITE};
+        MemTag mt {MEM_GEN};
+
+        drain(1);
+        _file.Close();
+}
+
+void CodeGen::SetOpt(int level)
+{
+        _opt = level;
+}
+
+int CodeGen::Opt(void) const
+{
+        return _opt;
+}
+
+void CodeGen::SetCache(Cache *cache)
+{
+        _cache = cache;
+}
+
+int CodeGen::Caching(void) const
+{
+        return _cache != nullptr;
+}
+
+const Emit &CodeGen::Out(void) const
+{
+        return _file;
+}
+
+CodeGen::~CodeGen()
+{
+        // jobs still queued point at us
+        if (_pool)
+                _pool->Wait();
+}
+
+size_t CodeGen::GenAst(AstRef n, size_t r, int parentop)
+{
+        auto &a = node(n);
         size_t left;
         size_t right;
 
-        switch (n->Type()) {
+        // folding can leave a body with nothing in it
+        if (n == NIL_AST)
+                return NIL_REG;
+
+        switch (a.Type()) {
         case AST_IF:
                 return genIfAst(n);
         case AST_WHILE:
                 return genWhile(n);
         case AST_GLUE:
-                GenAst(n->Left(), NIL_REG, n->Type());
-                Free();
-                GenAst(n->Right(), NIL_REG, n->Type());
-                Free();
+                GenAst(a.Left(), NIL_REG, a.Type());
+                GenAst(a.Right(), NIL_REG, a.Type());
                 return NIL_REG;
         case AST_FUNC:
-                funcPre(n->Id());
-                GenAst(n->Left(), NIL_REG, n->Type());
-                funcPost(n->Id());
-                return NIL_REG;
+                return genFunc(n);
+        }
+
+        // with optimization on, array elements and pointer arithmetic
+        // become memory operands of the load or store itself
+        if (_opt > 0) {
+                Mem m;
+
+                switch (a.Type()) {
+                case AST_DEREF:
+                        if (!a.Rval())
+                                break;
+                        genMem(a.Left(), m);
+                        return ldMem(m, node(a.Left()).Dtype());
+                case AST_ASSIGN:
+                        if (node(a.Right()).Type() != AST_DEREF)
+                                break;
+                        left = GenAst(a.Left(), NIL_REG, a.Type());
+                        genMem(node(a.Right()).Left(), m);
+                        return strMem(left, m, node(a.Right()).Dtype());
+                case AST_MUL:
+                case AST_DIV:
+                        // folding leaves constants on the right
+                        if (node(a.Right()).Type() != AST_INTLIT)
+                                break;
+                        left = GenAst(a.Left(), NIL_REG, a.Type());
+                        if (a.Type() == AST_MUL)
+                                return mulConst(left, node(a.Right()).Int());
+                        return divConst(left, node(a.Right()).Int());
+                }
         }
 
-        if (n->Left())
-                left = GenAst(n->Left(), NIL_REG, n->Type());
-        if (n->Right())
-                right = GenAst(n->Right(), left, n->Type());
+        if (a.Left())
+                left = GenAst(a.Left(), NIL_REG, a.Type());
+        if (a.Right())
+                right = GenAst(a.Right(), left, a.Type());
 
-        switch (n->Type()) {
+        switch (a.Type()) {
         case AST_ADD:
                 return add(left, right);
         case AST_SUB:
@@ -141,39 +486,40 @@ size_t CodeGen::GenAst(Ast *n, size_t r, int parentop)
         case AST_LE:
         case AST_GE:
                 if (parentop == AST_IF || parentop == AST_WHILE)
-                        return cmp_and_jmp(n->Type(), left, right, r);
-                return cmp_and_set(n->Type(), left, right);
+                        return cmp_and_jmp(a.Type(), left, right, r);
+                return cmp_and_set(a.Type(), left, right);
         case AST_INTLIT:
-                return movInt(n->Int());
+                return movInt(a.Int());
         case AST_IDENT:
-                if (n->Rval() || parentop == AST_DEREF)
-                        return movGlo(n->Id());
+                if (a.Rval() || parentop == AST_DEREF)
+                        return movVar(_tab.At(a.Ref()));
                 return NIL_REG;
         case AST_ASSIGN:
-                switch (n->Right()->Type()) {
+                switch (node(a.Right()).Type()) {
                 case AST_IDENT:
-                        return strGlo(left, n->Right()->Id());
+                        return strVar(left, _tab.At(node(a.Right()).Ref()));
                 case AST_DEREF:
-                        return strDeref(left, right, n->Right()->Dtype());
+                        return strDeref(left, right,
+                                        node(a.Right()).Dtype());
                 default:
-                        usage("bad operation: %s", n->Name().c_str());
+                        usage("bad operation: %s", a.Name().c_str());
                         exit(EXIT_FAILURE);
                 }
         case AST_WIDEN:
-                return widen(left, n->Left()->Dtype(), n->Dtype());
+                return widen(left, node(a.Left()).Dtype(), a.Dtype());
         case AST_RETURN:
-                ret(left, func_id);
+                ret(left, _func);
                 return NIL_REG;
         case AST_CALL:
-                return call(left, n->Id());
+                return call(left, _tab.At(a.Ref()));
         case AST_ADDR:
-                return addr(n->Id());
+                return addr(_tab.At(a.Ref()));
         case AST_DEREF:
-                if (n->Rval())
-                        return deref(left, n->Left()->Dtype());
+                if (a.Rval())
+                        return deref(left, node(a.Left()).Dtype());
                 return left;
         case AST_SCALE:
-                switch (n->Int()) {
+                switch (a.Int()) {
                 case 2:
                         return shl_const(left, 1);
                 case 4:
@@ -181,78 +527,248 @@ size_t CodeGen::GenAst(Ast *n, size_t r, int parentop)
                 case 8:
                         return shl_const(left, 3);
                 default:
-                        right = movInt(n->Int());
+                        right = movInt(a.Int());
                         return mul(left, right);
                 }
         default:
-                usage("invalid ast type: %s", n->Name().c_str());
+                usage("invalid ast type: %s", a.Name().c_str());
                 exit(EXIT_FAILURE);
         }
 }
 
 size_t CodeGen::add(size_t i, size_t j)
 {
-        fprintf(_fp, "\taddq\t%s, %s\n", _stk.Name(i), _stk.Name(j));
-        _stk.Put(i);
+        *_out << "\taddq\t" << _regs.Name(i) << ", " << _regs.Name(j) << "\n";
         return j;
 }
 
 size_t CodeGen::sub(size_t i, size_t j)
 {
-        fprintf(_fp, "\tsubq\t%s, %s\n", _stk.Name(j), _stk.Name(i));
-        _stk.Put(j);
+        *_out << "\tsubq\t" << _regs.Name(j) << ", " << _regs.Name(i) << "\n";
         return i;
 }
 
 size_t CodeGen::mul(size_t i, size_t j)
 {
-        fprintf(_fp, "\timulq\t%s, %s\n", _stk.Name(i), _stk.Name(j));
-        _stk.Put(i);
+        *_out << "\timulq\t" << _regs.Name(i) << ", " << _regs.Name(j) << "\n";
         return j;
 }
 
 size_t CodeGen::div(size_t i, size_t j)
 {
-        fprintf(_fp, "\tmovq\t%s, %%rax\n", _stk.Name(i));
-        fprintf(_fp, "\tcqo\n");
-        fprintf(_fp, "\tidivq\t%s\n", _stk.Name(j));
-        fprintf(_fp, "\tmovq\t%%rax, %s\n", _stk.Name(i));
-        _stk.Put(j);
+        clobber(REG_BIT(GPR_RAX));
+        *_out << "\tmovq\t" << _regs.Name(i) << ", %rax\n";
+        clobber(REG_BIT(GPR_RAX) | REG_BIT(GPR_RDX));
+        *_out << "\tcqo\n";
+        clobber(REG_BIT(GPR_RAX) | REG_BIT(GPR_RDX));
+        *_out << "\tidivq\t" << _regs.Name(j) << "\n"
+                "\tmovq\t%rax, " << _regs.Name(i) << "\n";
         return i;
 }
 
+// multiplier and shift dividing by d, from Hacker's Delight 10-1: for
+// 2 <= |d|, n / d is the high 64 bits of n * m, shifted right by s
+static void magic(long d, long &m, int &s)
+{
+        const uint64_t two63 = 1ull << 63;
+        uint64_t ad = d < 0 ? -(uint64_t)d : d;
+        uint64_t t = two63 + ((uint64_t)d >> 63);
+        uint64_t anc = t - 1 - t % ad;  // |nc|
+        int p = 63;
+        uint64_t q1 = two63 / anc;      // 2^p / |nc|
+        uint64_t r1 = two63 - q1 * anc; // rem(2^p, |nc|)
+        uint64_t q2 = two63 / ad;       // 2^p / |d|
+        uint64_t r2 = two63 - q2 * ad;  // rem(2^p, |d|)
+        uint64_t delta;
+
+        do {
+                p++;
+                q1 *= 2;
+                r1 *= 2;
+                if (r1 >= anc) {
+                        q1++;
+                        r1 -= anc;
+                }
+                q2 *= 2;
+                r2 *= 2;
+                if (r2 >= ad) {
+                        q2++;
+                        r2 -= ad;
+                }
+                delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+
+        m = (long)(q2 + 1);
+        if (d < 0)
+                m = -m;
+        s = p - 64;
+}
+
+size_t CodeGen::mulConst(size_t r, long c)
+{
+        uint64_t u = c < 0 ? -(uint64_t)c : c;
+        int k = u ? __builtin_ctzll(u) : 0;
+        auto odd = u >> k;
+        auto name = _regs.Name(r);
+
+        // imulq takes 3 cycles; shifts, adds, negq and leaq with no
+        // displacement take 1 each, so up to two of them win. x * 3, 5
+        // or 9 is one leaq, and a product of two of those is two
+        int lea[2] {0, 0};
+        int nlea {odd == 1 ? 0 : -1};
+        for (int f : {3, 5, 9}) {
+                if (odd == (uint64_t)f) {
+                        lea[0] = f;
+                        nlea = 1;
+                }
+        }
+        for (int f : {3, 5, 9}) {
+                for (int g : {3, 5, 9}) {
+                        if (nlea < 0 && f <= g &&
+                            odd == (uint64_t)(f * g)) {
+                                lea[0] = f;
+                                lea[1] = g;
+                                nlea = 2;
+                        }
+                }
+        }
+        if (nlea >= 0 && nlea + (k > 0) + (c < 0) <= 2) {
+                for (int i = 0; i < nlea; i++)
+                        *_out << "\tleaq\t(" << name << ", " << name << ", "
+                                << lea[i] - 1 << "), " << name << "\n";
+                if (k)
+                        *_out << "\tsalq\t$" << k << ", " << name << "\n";
+                if (c < 0)
+                        *_out << "\tnegq\t" << name << "\n";
+                return r;
+        }
+
+        // x * (2^m + 1) and x * (2^m - 1) are a shifted copy plus or
+        // minus x
+        if (c > 0 && k == 0 && u > 2) {
+                const char *op {nullptr};
+                int m;
+                if (((u - 1) & (u - 2)) == 0) {
+                        op = "addq";
+                        m = __builtin_ctzll(u - 1);
+                } else if (((u + 1) & u) == 0) {
+                        op = "subq";
+                        m = __builtin_ctzll(u + 1);
+                }
+                if (op) {
+                        auto t = _regs.Get();
+                        *_out << "\tmovq\t" << name << ", "
+                                << _regs.Name(t) << "\n"
+                                "\tsalq\t$" << m << ", " << _regs.Name(t)
+                                << "\n"
+                                "\t" << op << "\t" << name << ", "
+                                << _regs.Name(t) << "\n";
+                        return t;
+                }
+        }
+
+        return mul(r, movInt(c));
+}
+
+size_t CodeGen::divConst(size_t r, long d)
+{
+        uint64_t u = d < 0 ? -(uint64_t)d : d;
+
+        // dividing by zero is left to fault at run time
+        if (d == 0 || d == 1)
+                return d ? r : div(r, movInt(d));
+        if (d == -1) {
+                *_out << "\tnegq\t" << _regs.Name(r) << "\n";
+                return r;
+        }
+
+        // by 2^k: round toward zero by adding 2^k - 1 to negative
+        // dividends before shifting
+        if ((u & (u - 1)) == 0) {
+                int k = __builtin_ctzll(u);
+                auto t = _regs.Get();
+                auto name = _regs.Name(t);
+
+                *_out << "\tmovq\t" << _regs.Name(r) << ", " << name << "\n";
+                if (k > 1)
+                        *_out << "\tsarq\t$63, " << name << "\n";
+                *_out << "\tshrq\t$" << 64 - k << ", " << name << "\n"
+                        "\taddq\t" << _regs.Name(r) << ", " << name << "\n"
+                        "\tsarq\t$" << k << ", " << name << "\n";
+                if (d < 0)
+                        *_out << "\tnegq\t" << name << "\n";
+                return t;
+        }
+
+        // the high half of the product is in %rdx; it is corrected for a
+        // multiplier of the wrong sign, shifted, and rounded toward zero
+        // by adding one if negative
+        long m;
+        int s;
+        magic(d, m, s);
+
+        auto name = _regs.Name(r);
+        clobber(REG_BIT(GPR_RAX));
+        *_out << (m == (int32_t)m ? "\tmovq\t$" : "\tmovabsq\t$") << m
+                << ", %rax\n";
+        clobber(REG_BIT(GPR_RAX) | REG_BIT(GPR_RDX));
+        *_out << "\timulq\t" << name << "\n";
+        if (d > 0 && m < 0) {
+                clobber(REG_BIT(GPR_RDX));
+                *_out << "\taddq\t" << name << ", %rdx\n";
+        } else if (d < 0 && m > 0) {
+                clobber(REG_BIT(GPR_RDX));
+                *_out << "\tsubq\t" << name << ", %rdx\n";
+        }
+        if (s) {
+                clobber(REG_BIT(GPR_RDX));
+                *_out << "\tsarq\t$" << s << ", %rdx\n";
+        }
+        clobber(REG_BIT(GPR_RDX));
+        *_out << "\tmovq\t%rdx, " << name << "\n";
+        *_out << "\tshrq\t$63, " << name << "\n";
+        clobber(REG_BIT(GPR_RDX));
+        *_out << "\taddq\t%rdx, " << name << "\n";
+        return r;
+}
+
 size_t CodeGen::movInt(int v)
 {
-        size_t r = _stk.Get();
-        fprintf(_fp, "\tmovq\t$%d, %s\n", v, _stk.Name(r));
+        size_t r = _regs.Get();
+        *_out << "\tmovq\t$" << v << ", " << _regs.Name(r) << "\n";
         return r;
 }
 
-size_t CodeGen::movGlo(const std::string &id)
+void CodeGen::var(const Sym *s)
 {
-        size_t r = _stk.Get();
-        auto s = _tab.Get(id);
+        if (s->Local())
+                *_out << s->Off() << "(%rbp)";
+        else
+                *_out << interner.Name(s->Name()) << "(%rip)";
+}
+
+size_t CodeGen::movVar(const Sym *s)
+{
+        size_t r = _regs.Get();
 
         switch (s->Prim()) {
         case TYPE_CHAR:
-                fprintf(_fp, "movzbq\t%s(%%rip), %s\n", id.c_str(),
-                                _stk.Name(r));
+                *_out << "movzbq\t";
+                var(s);
+                *_out << ", " << _regs.Name(r) << "\n";
                 break;
         case TYPE_INT:
-                /* NOTE: this is the assembly line that was
-                 * having problems: it use to be movzbl but the
-                 * assembler didn't like that, but it likes this
-                 * and i dont know why
-                 */
-                fprintf(_fp, "movzbq\t%s(%%rip), %s\n", id.c_str(),
-                                _stk.Name(r));
+                *_out << "\tmovslq\t";
+                var(s);
+                *_out << ", " << _regs.Name(r) << "\n";
                 break;
         case TYPE_LONG:
         case TYPE_CHAR_P:
         case TYPE_INT_P:
         case TYPE_LONG_P:
-                fprintf(_fp, "\tmovq\t%s(%%rip), %s\n", id.c_str(),
-                                _stk.Name(r));
+                *_out << "\tmovq\t";
+                var(s);
+                *_out << ", " << _regs.Name(r) << "\n";
                 break;
         default:
                 usage("invalid data type: %s", type_name(s->Prim()));
@@ -262,64 +778,62 @@ size_t CodeGen::movGlo(const std::string &id)
         return r;
 }
 
-size_t CodeGen::strGlo(size_t r, const std::string &id)
+size_t CodeGen::strVar(size_t r, const Sym *s)
 {
-        std::string reg;
-        auto s = _tab.Get(id);
 
         switch (s->Prim()) {
         case TYPE_CHAR:
-                reg = std::string{_stk.Name(r)} + "b";
-                fprintf(_fp, "\tmovb\t%s, %s(%%rip)\n",
-                                reg.c_str(), id.c_str());
+                *_out << "\tmovb\t" << _regs.Name(r, 1) << ", ";
                 break;;
         case TYPE_INT:
-                reg = std::string{_stk.Name(r)} + "d";
-                fprintf(_fp, "movl\t%s, %s(%%rip)\n",
-                                reg.c_str(), id.c_str());
+                *_out << "movl\t" << _regs.Name(r, 4) << ", ";
                 break;
         case TYPE_LONG:
         case TYPE_CHAR_P:
         case TYPE_INT_P:
         case TYPE_LONG_P:
-                fprintf(_fp, "movq\t%s, %s(%%rip)\n",
-                                _stk.Name(r), id.c_str());
+                *_out << "movq\t" << _regs.Name(r) << ", ";
                 break;
         default:
                 usage("bad primitive: %s", type_name(s->Prim()));
                 exit(1);
         }
+        var(s);
+        *_out << "\n";
 
         return r;
 }
 
-Sym *CodeGen::GetGlo(const std::string &id)
+Sym *CodeGen::GetGlo(Ident id)
 {
         return _tab.Get(id);
 }
 
-void CodeGen::Free(void)
+Sym *CodeGen::SetGlo(int prim, int stype, int end, Ident id)
+{
+        return _tab.Set(id, Sym{prim, stype, end, id});
+}
+
+Sym *CodeGen::SetGlo(int prim, int stype, int end, Ident id, int size)
 {
-        _stk.Free();
+        return _tab.Set(id, Sym{prim, stype, end, id, size});
 }
 
-void CodeGen::SetGlo(int prim, int stype, int end, const std::string &id)
+void CodeGen::OpenScope(void)
 {
-        _tab.Set(id, new Sym{prim, stype, end, id});
+        _tab.Push();
 }
 
-void CodeGen::SetGlo(int prim, int stype, int end, const std::string &id, int size)
+void CodeGen::CloseScope(void)
 {
-        _tab.Set(id, new Sym{prim, stype, end, id, size});
+        _tab.Pop();
 }
 
-size_t CodeGen::cmp(size_t i, size_t j, const std::string &how)
+size_t CodeGen::cmp(size_t i, size_t j, const char *how)
 {
-        std::string breg = std::string{_stk.Name(j)} + "b";
-        fprintf(_fp, "\tcmpq\t%s, %s\n", _stk.Name(j), _stk.Name(i));
-        fprintf(_fp, "\t%s\t%s\n", how.c_str(), breg.c_str());
-        fprintf(_fp, "\tandq\t$255, %s\n", _stk.Name(j));
-        _stk.Put(i);
+        *_out << "\tcmpq\t" << _regs.Name(j) << ", " << _regs.Name(i) << "\n"
+                "\t" << how << "\t" << _regs.Name(j, 1) << "\n"
+                "\tandq\t$255, " << _regs.Name(j) << "\n";
         return j;
 }
 
@@ -353,14 +867,26 @@ size_t CodeGen::ge(size_t i, size_t j)
         return cmp(i, j, "setge");
 }
 
+void CodeGen::labelRef(int label)
+{
+        if (_fixups)
+                _fixups->push_back(Fixup{(uint32_t)_out->Size(),
+                                label - _base});
+        *_out << label;
+}
+
 void CodeGen::jmp(int label)
 {
-        fprintf(_fp, "\tjmp\tL%d\n", label);
+        *_out << "\tjmp\tL";
+        labelRef(label);
+        *_out << "\n";
 }
 
 void CodeGen::label(int l)
 {
-        fprintf(_fp, "L%d:\n", l);
+        *_out << "L";
+        labelRef(l);
+        *_out << ":\n";
 }
 
 size_t CodeGen::cmp_and_jmp(int type, size_t i, size_t j, int label)
@@ -376,12 +902,13 @@ size_t CodeGen::cmp_and_jmp(int type, size_t i, size_t j, int label)
 
         if (type < AST_EQ || type > AST_GE) {
                 usage("cmp_and_jmp: bad ast type",
-                                Ast{type, TYPE_NONE, 0}.Name().c_str());
+                                ast_name(type).c_str());
         }
 
-        fprintf(_fp, "\tcmpq\t%s, %s\n", _stk.Name(j), _stk.Name(i));
-        fprintf(_fp, "\t%s\tL%d\n", jmps[type - AST_EQ], label);
-        Free();
+        *_out << "\tcmpq\t" << _regs.Name(j) << ", " << _regs.Name(i) << "\n"
+                "\t" << jmps[type - AST_EQ] << "\tL";
+        labelRef(label);
+        *_out << "\n";
         return NIL_REG;
 }
 
@@ -395,52 +922,49 @@ size_t CodeGen::cmp_and_set(int type, size_t i, size_t j)
                 "setle",
                 "setge",
         };
-        std::string b = std::string{_stk.Name(j)} + "b";
+        auto b = _regs.Name(j, 1);
 
         if (type < AST_EQ || type > AST_GE) {
                 usage("cmp_and_set: bad ast type: %s\n",
-                                Ast{type, TYPE_NONE, 0}.Name().c_str());
+                                ast_name(type).c_str());
         }
 
-        fprintf(_fp, "\tcmpq\t%s, %s\n", _stk.Name(j), _stk.Name(i));
-        fprintf(_fp, "\t%s\t%s\n", sets[type - AST_EQ], b.c_str());
-        fprintf(_fp, "\tmovzbq\t%s, %s\n", b.c_str(), _stk.Name(j));
-        _stk.Put(i);
+        *_out << "\tcmpq\t" << _regs.Name(j) << ", " << _regs.Name(i) << "\n"
+                "\t" << sets[type - AST_EQ] << "\t" << b << "\n"
+                "\tmovzbq\t" << b << ", " << _regs.Name(j) << "\n";
         return j;
 }
 
-size_t CodeGen::genWhile(Ast *n)
+size_t CodeGen::genWhile(AstRef n)
 {
+        auto &a = node(n);
         auto start = GetLabel();
         auto end = GetLabel();
         label(start);
-        GenAst(n->Left(), end, n->Type());
-        Free();
-        GenAst(n->Right(), NIL_REG, n->Type());
-        Free();
+        GenAst(a.Left(), end, a.Type());
+        GenAst(a.Right(), NIL_REG, a.Type());
         jmp(start);
         label(end);
         return NIL_REG;
 }
 
-void CodeGen::funcPre(const std::string &id)
+void CodeGen::funcPre(const Sym *s)
 {
-        fprintf(_fp,
-                "\t.text\n"
-                "\t.globl\t%s\n"
-                "\t.type\t%s, @function\n"
-                "%s:\n"
-                "\tpushq\t%%rbp\n"
-                "\tmovq\t%%rsp, %%rbp\n",
-                id.c_str(),
-                id.c_str(),
-                id.c_str());
+        auto name = interner.Name(s->Name());
+
+        *_out << "\t.text\n"
+                "\t.globl\t" << name << "\n"
+                "\t.type\t" << name << ", @function\n"
+                << name << ":\n"
+                "\tpushq\t%rbp\n"
+                "\tmovq\t%rsp, %rbp\n";
+        _regs.Enter(*_out);
 }
 
 void
-CodeGen::funcPost(const std::string& id)
+CodeGen::funcPost(const Sym *s)
 {
-        GenPost(id);
+        GenPost(s);
 }
 
 size_t CodeGen::widen(size_t r, int oldtype, int newtype)
@@ -451,7 +975,7 @@ size_t CodeGen::widen(size_t r, int oldtype, int newtype)
 size_t CodeGen::PrimSize(int prim)
 {
         static int sizes[] = {
-                0, 0, 1, 4, 8, 8, 8, 8,
+                0, 0, 1, 4, 8, 8, 8, 8, 8,
         };
 
         if (prim < 0 || prim >= (int)(sizeof(sizes) / sizeof(*sizes)))
@@ -460,22 +984,18 @@ size_t CodeGen::PrimSize(int prim)
         return sizes[prim];
 }
 
-void CodeGen::ret(size_t r, const std::string& id)
+void CodeGen::ret(size_t r, const Sym *s)
 {
-        std::string reg;
-        auto s = _tab.Get(id);
-
+        clobber(REG_BIT(GPR_RAX));
         switch (s->Prim()) {
         case TYPE_CHAR:
-                reg = std::string{_stk.Name(r)} + "b";
-                fprintf(_fp, "\tmovzbl\t%s, %%eax\n", reg.c_str());
+                *_out << "\tmovzbl\t" << _regs.Name(r, 1) << ", %eax\n";
                 break;
         case TYPE_INT:
-                reg = std::string{_stk.Name(r)} + "d";
-                fprintf(_fp, "\tmovl\t%s, %%eax\n", reg.c_str());
+                *_out << "\tmovl\t" << _regs.Name(r, 4) << ", %eax\n";
                 break;
         case TYPE_LONG:
-                fprintf(_fp, "\tmovq\t%s, %%rax\n", _stk.Name(r));
+                *_out << "\tmovq\t" << _regs.Name(r) << ", %rax\n";
                 break;
         default:
                 usage("bad type: %s", type_name(s->Prim()));
@@ -485,20 +1005,24 @@ void CodeGen::ret(size_t r, const std::string& id)
         jmp(s->End());
 }
 
-size_t CodeGen::call(size_t r, const std::string& id)
+size_t CodeGen::call(size_t r, const Sym *s)
 {
-        size_t out = _stk.Get();
-        fprintf(_fp, "\tmovq\t%s, %%rdi\n", _stk.Name(r));
-        fprintf(_fp, "\tcall\t%s\n", id.c_str());
-        fprintf(_fp, "\tmovq\t%%rax, %s\n", _stk.Name(out));
-        _stk.Put(r);
+        size_t out = _regs.Get();
+
+        clobber(REG_BIT(GPR_RDI));
+        *_out << "\tmovq\t" << _regs.Name(r) << ", %rdi\n";
+        clobber(REGS_CALLER);
+        *_out << "\tcall\t" << interner.Name(s->Name()) << "\n"
+                "\tmovq\t%rax, " << _regs.Name(out) << "\n";
         return out;
 }
 
-size_t CodeGen::addr(const std::string& id)
+size_t CodeGen::addr(const Sym *s)
 {
-        auto r = _stk.Get();
-        fprintf(_fp, "\tleaq\t%s(%%rip), %s\n", id.c_str(), _stk.Name(r));
+        auto r = _regs.Get();
+        *_out << "\tleaq\t";
+        var(s);
+        *_out << ", " << _regs.Name(r) << "\n";
         return r;
 }
 
@@ -506,16 +1030,16 @@ size_t CodeGen::deref(size_t r, int datatype)
 {
         switch (datatype) {
         case TYPE_CHAR_P:
-                fprintf(_fp, "\tmovzbq\t(%s), %s\n", _stk.Name(r),
-                                _stk.Name(r));
+                *_out << "\tmovzbq\t(" << _regs.Name(r) << "), "
+                        << _regs.Name(r) << "\n";
                 break;
         case TYPE_INT_P:
-                fprintf(_fp, "\tmovq\t(%s), %s\n", _stk.Name(r),
-                                _stk.Name(r));
+                *_out << "\tmovslq\t(" << _regs.Name(r) << "), "
+                        << _regs.Name(r) << "\n";
                 break;
         case TYPE_LONG_P:
-                fprintf(_fp, "\tmovq\t(%s), %s\n", _stk.Name(r),
-                                _stk.Name(r));
+                *_out << "\tmovq\t(" << _regs.Name(r) << "), "
+                        << _regs.Name(r) << "\n";
                 break;
         }
         return r;
@@ -523,24 +1047,24 @@ size_t CodeGen::deref(size_t r, int datatype)
 
 size_t CodeGen::shl_const(size_t r, int val)
 {
-        fprintf(_fp, "\tsalq\t$%d, %s\n", val, _stk.Name(r));
+        *_out << "\tsalq\t$" << val << ", " << _regs.Name(r) << "\n";
         return r;
 }
 
 size_t CodeGen::strDeref(size_t r1, size_t r2, int type)
 {
-        std::string reg;
-
         switch (type) {
         case TYPE_CHAR:
-                reg = std::string{_stk.Name(r1)} + "b";
-                fprintf(_fp, "\tmovb\t%s, (%s)\n",
-                        reg.c_str(), _stk.Name(r2));
+                *_out << "\tmovb\t" << _regs.Name(r1, 1) << ", ("
+                        << _regs.Name(r2) << ")\n";
                 break;
         case TYPE_INT:
+                *_out << "\tmovl\t" << _regs.Name(r1, 4) << ", ("
+                        << _regs.Name(r2) << ")\n";
+                break;
         case TYPE_LONG:
-                fprintf(_fp, "\tmovq\t%s, (%s)\n",
-                        _stk.Name(r1), _stk.Name(r2));
+                *_out << "\tmovq\t" << _regs.Name(r1) << ", ("
+                        << _regs.Name(r2) << ")\n";
                 break;
         default:
                 usage("bad deref");
@@ -548,3 +1072,150 @@ size_t CodeGen::strDeref(size_t r1, size_t r2, int type)
 
         return r1;
 }
+
+void CodeGen::genMem(AstRef n, Mem &m)
+{
+        auto &a = node(n);
+
+        m = Mem{nullptr, NIL_REG, NIL_REG, 1, 0};
+        if (a.Type() != AST_ADD) {
+                memBase(n, m);
+        } else if (node(a.Left()).Dtype() == a.Dtype()) {
+                // the pointer is the side of the type of the sum; both
+                // sides are generated in order all the same
+                memBase(a.Left(), m);
+                memIndex(a.Right(), m);
+        } else {
+                memIndex(a.Left(), m);
+                memBase(a.Right(), m);
+        }
+
+        // a global is addressed relative to %rip, which takes no index
+        if (m.sym && !m.sym->Local() && m.index != NIL_REG) {
+                m.base = addr(m.sym);
+                m.sym = nullptr;
+        }
+}
+
+void CodeGen::memBase(AstRef n, Mem &m)
+{
+        auto &a = node(n);
+
+        if (a.Type() == AST_ADDR)
+                m.sym = _tab.At(a.Ref());
+        else
+                m.base = GenAst(n, NIL_REG, AST_DEREF);
+}
+
+void CodeGen::memIndex(AstRef n, Mem &m)
+{
+        auto x = n;
+        int scale {1};
+        long disp {0};
+
+        if (node(x).Type() == AST_SCALE) {
+                switch (node(x).Int()) {
+                case 2:
+                case 4:
+                case 8:
+                        scale = node(x).Int();
+                        x = node(x).Left();
+                }
+        }
+
+        // constant terms of the index go into the displacement
+        while (x != NIL_AST) {
+                auto &b = node(x);
+
+                if (b.Type() == AST_INTLIT) {
+                        disp += b.Int();
+                        x = NIL_AST;
+                } else if ((b.Type() == AST_ADD || b.Type() == AST_SUB) &&
+                           node(b.Right()).Type() == AST_INTLIT) {
+                        auto c = (long)node(b.Right()).Int();
+                        disp += b.Type() == AST_ADD ? c : -c;
+                        x = b.Left();
+                } else if (b.Type() == AST_ADD &&
+                           node(b.Left()).Type() == AST_INTLIT) {
+                        disp += node(b.Left()).Int();
+                        x = b.Right();
+                } else {
+                        break;
+                }
+        }
+
+        // displacements are 32 bits, with room for a frame offset
+        disp = m.disp + disp * scale;
+        if (disp < -(1l << 30) || disp > 1l << 30) {
+                m.index = GenAst(n, NIL_REG, AST_ADD);
+                return;
+        }
+        m.disp = disp;
+        if (x != NIL_AST) {
+                m.index = GenAst(x, NIL_REG, AST_ADD);
+                m.scale = scale;
+        }
+}
+
+void CodeGen::mem(const Mem &m)
+{
+        if (m.sym && !m.sym->Local()) {
+                *_out << interner.Name(m.sym->Name());
+                if (m.disp > 0)
+                        *_out << "+";
+                if (m.disp)
+                        *_out << m.disp;
+                *_out << "(%rip)";
+                return;
+        }
+
+        auto disp = m.disp + (m.sym ? m.sym->Off() : 0);
+        if (disp)
+                *_out << disp;
+        *_out << "(" << (m.sym ? "%rbp" : _regs.Name(m.base));
+        if (m.index != NIL_REG)
+                *_out << ", " << _regs.Name(m.index) << ", " << m.scale;
+        *_out << ")";
+}
+
+size_t CodeGen::ldMem(const Mem &m, int datatype)
+{
+        auto r = _regs.Get();
+
+        switch (datatype) {
+        case TYPE_CHAR_P:
+                *_out << "\tmovzbq\t";
+                break;
+        case TYPE_INT_P:
+                *_out << "\tmovslq\t";
+                break;
+        case TYPE_LONG_P:
+                *_out << "\tmovq\t";
+                break;
+        default:
+                usage("bad deref");
+        }
+        mem(m);
+        *_out << ", " << _regs.Name(r) << "\n";
+        return r;
+}
+
+size_t CodeGen::strMem(size_t r, const Mem &m, int type)
+{
+        switch (type) {
+        case TYPE_CHAR:
+                *_out << "\tmovb\t" << _regs.Name(r, 1) << ", ";
+                break;
+        case TYPE_INT:
+                *_out << "\tmovl\t" << _regs.Name(r, 4) << ", ";
+                break;
+        case TYPE_LONG:
+                *_out << "\tmovq\t" << _regs.Name(r) << ", ";
+                break;
+        default:
+                usage("bad deref");
+        }
+        mem(m);
+        *_out << "\n";
+        return r;
+}
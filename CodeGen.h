@@ -2,26 +2,114 @@
 #define CODEGEN_H
 
 #include "Ast.h"
+#include "Cache.h"
+#include "Emit.h"
 #include "Error.h"
-#include "RegStk.h"
+#include "Hash.h"
+#include "Peephole.h"
+#include "Pool.h"
+#include "RegAlloc.h"
 #include "SymTab.h"
+#include "Timer.h"
+#include "Trace.h"
+#include <atomic>
 #include <cstdio>
+#include <deque>
+#include <memory>
 #include <string>
 #include "Type.h"
 
 #define NIL_REG (size_t)-1
 
+// bump when generated code changes, to retire old cache entries
+#define CACHE_VERSION 7
+
 // code generator
 class CodeGen {
 private:
-        std::string     _path;  // path name of output file
-        RegStk          _stk;   // register stack
-        SymTab          _tab;   // symbol table
-        FILE            *_fp;   // output file
-        int             _id;    // id of next available label
-
-        // generate instructions for global variable
-        void genGlo(const std::string &id);
+        // function handed to the thread pool
+        struct Job {
+                AstPool                 ast;    // nodes of function
+                AstRef                  root;   // AST_FUNC node
+                int                     label;  // first label of function
+                Emit                    out;    // generated code
+                Digest                  key;    // cache key
+                std::vector<Fixup>      fixups; // label numbers in out
+                std::string             err;    // diagnostic if it failed
+                FuncTimes               *time;  // times of function or null
+                std::atomic<int>        done;   // code generated?
+        };
+
+        // memory operand: disp(base, index, scale), where a variable
+        // stands for its own base and displacement
+        struct Mem {
+                const Sym       *sym;   // variable addressed, or null
+                size_t          base;   // register of base, or NIL_REG
+                size_t          index;  // register of index, or NIL_REG
+                int             scale;  // 1, 2, 4 or 8
+                long            disp;   // constant offset
+        };
+
+        std::string                     _path;  // path name of output file
+        RegAlloc                        _regs;  // register allocator
+        SymTab                          _owntab;// symbol table
+        SymTab                          &_tab;  // symbol table in use
+        Emit                            _file;  // output file
+        Emit                            *_out;  // output in use
+        Emit                            _body;  // function being generated,
+                                                // before register allocation
+        Peephole                        _peep;  // peephole optimizer
+        Emit                            _asm;   // function after register
+                                                // allocation, before the
+                                                // peephole optimizer
+        int                             _id;    // id of next available label
+        const AstPool                   *_ast;  // nodes of function being
+                                                // generated
+        const Sym                       *_func; // function being generated
+        std::unique_ptr<Pool>           _pool;  // back end threads or null
+        std::deque<std::unique_ptr<Job>> _jobs; // output not yet written,
+                                                // in source order
+        Cache                           *_cache;// function cache or null
+        std::vector<Fixup>              *_fixups;// where to note label
+                                                // numbers, or null
+        int                             _base;  // first label of function
+        int                             _opt;   // optimization level
+
+        // @tab:        symbol table of parent
+        // @out:        output of one function
+        // @label:      first label reserved for function
+        CodeGen(SymTab &tab, Emit &out, int label);
+
+        // get node of function being generated
+        const Ast &node(AstRef n) const;
+
+        // count labels generating a subtree takes
+        int countLabels(const AstPool &ast, AstRef n) const;
+
+        // get cache key of function at the optimization level
+        //
+        // @ast:        nodes of function
+        // @toks:       hash of tokens of function
+        Digest funcKey(const AstPool &ast, const Digest &toks);
+
+        // generate a function, on a pool thread or in place
+        void runJob(Job *job, const AstPool &ast, int nlabels);
+
+        // write a label number
+        void labelRef(int label);
+
+        // note that the line about to be written clobbers registers
+        void clobber(uint32_t regs);
+
+        // generate a function: its body with virtual registers, then
+        // the registers allocated and the frame around them
+        size_t genFunc(AstRef n);
+
+        // write out finished jobs at front of queue
+        //
+        // @wait:       wait for all jobs first?
+        void drain(int wait);
+
         // generate add instruction
         size_t add(size_t i, size_t j);
         // generate sub instruction
@@ -30,14 +118,23 @@ private:
         size_t mul(size_t i, size_t j);
         // generate div instruction
         size_t div(size_t i, size_t j);
+        // generate multiply by constant, with shifts and leaq where they
+        // are quicker than imulq
+        size_t mulConst(size_t r, long c);
+        // generate divide by constant, with a multiply by its reciprocal
+        // in place of idivq
+        size_t divConst(size_t r, long d);
         // generate mov for integer
         size_t movInt(int v);
-        // generate mov for global variable
-        size_t movGlo(const std::string &id);
-        // generate store for global variable
-        size_t strGlo(size_t r, const std::string &id);
+        // write memory operand of variable: global ones are addressed
+        // relative to %rip, locals relative to %rbp
+        void var(const Sym *s);
+        // generate load of variable
+        size_t movVar(const Sym *s);
+        // generate store to variable
+        size_t strVar(size_t r, const Sym *s);
         // generate instructions for comparison
-        size_t cmp(size_t i, size_t j, const std::string &how);
+        size_t cmp(size_t i, size_t j, const char *how);
         // generate instructions for equality test
         size_t eq(size_t i, size_t j);
         // generate instructions for not equal test
@@ -51,7 +148,7 @@ private:
         // generate instructions for greater than or equal test
         size_t ge(size_t i, size_t j);
         // generate instructions for if statement
-        size_t genIfAst(Ast *n);
+        size_t genIfAst(AstRef n);
         // generate jump instruction
         void jmp(int label);
         // generate label instruction
@@ -61,62 +158,119 @@ private:
         // generate compare and set
         size_t cmp_and_set(int type, size_t i, size_t j);
         // generate code for while statement
-        size_t genWhile(Ast *n);
+        size_t genWhile(AstRef n);
         // generate function preamble
-        void funcPre(const std::string &id);
+        void funcPre(const Sym *s);
         // generate function postamble
-        void funcPost(const std::string &id);
+        void funcPost(const Sym *s);
         // widen a data type
         size_t widen(size_t r, int oldtype, int newtype);
         // generate a return
-        void ret(size_t r, const std::string& id);
+        void ret(size_t r, const Sym *s);
         // generate a call
-        size_t call(size_t r, const std::string& id);
+        size_t call(size_t r, const Sym *s);
         // generate instructions to take address
-        size_t addr(const std::string& id);
+        size_t addr(const Sym *s);
         // generate dereference
         size_t deref(size_t r, int datatype);
         // generate constant left shift
         size_t shl_const(size_t r, int val);
         // store through a pointer
         size_t strDeref(size_t r1, size_t r2, int type);
+        // generate the parts of an address for a memory operand, folding
+        // an array, a scaled index and constant offsets into it
+        void genMem(AstRef n, Mem &m);
+        // generate base of memory operand
+        void memBase(AstRef n, Mem &m);
+        // generate index of memory operand
+        void memIndex(AstRef n, Mem &m);
+        // write memory operand
+        void mem(const Mem &m);
+        // generate load from memory operand
+        size_t ldMem(const Mem &m, int datatype);
+        // generate store to memory operand
+        size_t strMem(size_t r, const Mem &m, int type);
 public:
         // @path:       path name of output file
         CodeGen(const std::string &path);
 
-        ~CodeGen();
+        // generate into memory, see Out()
+        CodeGen(void);
+
+        CodeGen(const CodeGen &) = delete;
+        CodeGen &operator=(const CodeGen &) = delete;
+
+        // generate functions on n threads
+        //
+        // functions are generated in any order but written out in source
+        // order, and each one gets the labels it would get serially, so
+        // the output does not change
+        void Parallel(size_t n);
 
         // generate preamble
         void GenPre(void);
 
         // generate postamble
-        void GenPost(const std::string& id);
+        void GenPost(const Sym *s);
 
         // generate code to print int
         void GenPrintInt(size_t r);
 
+        // generate code for function
+        //
+        // @ast:        nodes of function
+        // @n:          AST_FUNC node
+        // @toks:       hash of tokens of function, used if caching
+        void GenFunc(const AstPool &ast, AstRef n, const Digest &toks);
+
+        // set optimization level: 0 does not fold constants, 2 and up
+        // allocate registers by graph coloring instead of linear scan
+        void SetOpt(int level);
+
+        // get optimization level
+        int Opt(void) const;
+
+        // look functions up in cache before generating them, and store
+        // the ones generated
+        void SetCache(Cache *cache);
+
+        // is a cache set?
+        int Caching(void) const;
+
         // generate code for AST
-        size_t GenAst(Ast *n, size_t r, int parentop);
+        size_t GenAst(AstRef n, size_t r, int parentop);
 
         // generate code for global variable
-        void GenGlo(const std::string &id);
+        void GenGlo(const Sym *s);
 
         // get symbol
-        Sym *GetGlo(const std::string &id);
+        Sym *GetGlo(Ident id);
 
-        // free all registers
-        void Free(void);
+        // declare symbol in innermost scope
+        Sym *SetGlo(int prim, int stype, int end, Ident id);
 
-        // get symbol
-        void SetGlo(int prim, int stype, int end, const std::string &id);
+        Sym *SetGlo(int prim, int stype, int end, Ident id, int size);
+
+        // open a block scope
+        void OpenScope(void);
 
-        void SetGlo(int prim, int stype, int end, const std::string &id, int size);
+        // close innermost block scope, unbinding the names declared in it
+        void CloseScope(void);
 
         // get primitive data type size
         size_t PrimSize(int prim);
 
         // get a new label
         int GetLabel(void);
+
+        // wait for functions still being generated, write them out and
+        // close output file
+        void Finish(void);
+
+        // get generated code; complete after Finish()
+        const Emit &Out(void) const;
+
+        ~CodeGen();
 };
 
 #endif
@@ -0,0 +1,47 @@
+#include "Compiler.h"
+
+Compiler::Compiler(const std::string &in, const std::string &out)
+        : _lex {in},
+        _cg {out},
+        _parser {}
+{}
+
+Compiler::Compiler(const std::string &name, const char *buf, size_t len)
+        : _lex {name, buf, len},
+        _cg {},
+        _parser {}
+{}
+
+Lexer &Compiler::Lex(void)
+{
+        return _lex;
+}
+
+CodeGen &Compiler::Gen(void)
+{
+        return _cg;
+}
+
+void Compiler::Run(void)
+{
+        TraceSpan ts {"compile"};
+
+        ts.Arg(_lex.Path());
+        _parser.reset(new Parser{_lex, _cg});
+
+        _cg.SetGlo(TYPE_CHAR, STYPE_FUNC, 0, interner.Intern("printint"));
+
+        _cg.GenPre();
+        _parser->ParseDecls();
+        _cg.Finish();
+}
+
+const AstPool &Compiler::Nodes(void) const
+{
+        return _parser->Nodes();
+}
+
+const Emit &Compiler::Out(void) const
+{
+        return _cg.Out();
+}
@@ -0,0 +1,51 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "CodeGen.h"
+#include "Error.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include <memory>
+#include <string>
+
+// one compilation
+//
+// all state of a compilation lives here, so any number of them may run
+// at once in one process. only the interner is shared
+class Compiler {
+private:
+        Lexer                   _lex;   // lexical analyzer
+        CodeGen                 _cg;    // code generator
+        std::unique_ptr<Parser> _parser;// parser, made by Run()
+public:
+        // @in:         path name of input
+        // @out:        path name of output
+        Compiler(const std::string &in, const std::string &out);
+
+        // compile from memory into memory, see Out()
+        //
+        // @name:       name to report input by
+        // @buf:        source text, copied
+        // @len:        length of source text
+        Compiler(const std::string &name, const char *buf, size_t len);
+
+        Compiler(const Compiler &) = delete;
+        Compiler &operator=(const Compiler &) = delete;
+
+        // get lexical analyzer, to set it up before Run()
+        Lexer &Lex(void);
+
+        // get code generator, to set it up before Run()
+        CodeGen &Gen(void);
+
+        // parse input and generate code
+        void Run(void);
+
+        // get nodes of parser; valid after Run()
+        const AstPool &Nodes(void) const;
+
+        // get generated code of in-memory compilation
+        const Emit &Out(void) const;
+};
+
+#endif
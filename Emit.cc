@@ -0,0 +1,130 @@
+#include "Emit.h"
+#include "Mem.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+Emit::Emit(void)
+        : _path {},
+        _fd {-1},
+        _buf {},
+        _len {0}
+{}
+
+Emit::Emit(const std::string &path)
+        : _path {path},
+        _fd {open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)},
+        _buf {},
+        _len {0}
+{
+        MemTag mt {MEM_GEN};
+
+        if (_fd < 0)
+                error("could not open %s", path.c_str());
+        _buf.resize(SIZE);
+}
+
+const char *Emit::Data(void) const
+{
+        return _buf.data();
+}
+
+size_t Emit::Size(void) const
+{
+        return _len;
+}
+
+void Emit::Clear(void)
+{
+        if (_fd < 0)
+                _len = 0;
+}
+
+void Emit::Flush(void)
+{
+        size_t off {0};
+
+        if (_fd < 0)
+                return;
+
+        while (off < _len) {
+                auto n = write(_fd, _buf.data() + off, _len - off);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        error("could not write %s", _path.c_str());
+                }
+                off += n;
+        }
+        _len = 0;
+}
+
+void Emit::spill(const char *s, size_t n)
+{
+        if (_fd < 0) {
+                auto size = _buf.size() < 4096 ? 4096 : _buf.size() * 2;
+                while (size < _len + n)
+                        size *= 2;
+                _buf.resize(size);
+                memcpy(_buf.data() + _len, s, n);
+                _len += n;
+                return;
+        }
+
+        Flush();
+        if (n <= SIZE) {
+                memcpy(_buf.data(), s, n);
+                _len = n;
+                return;
+        }
+
+        // too big to buffer, write it straight out
+        while (n > 0) {
+                auto w = write(_fd, s, n);
+                if (w < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        error("could not write %s", _path.c_str());
+                }
+                s += w;
+                n -= w;
+        }
+}
+
+Emit &Emit::operator<<(long v)
+{
+        char tmp[24];
+        auto p = tmp + sizeof(tmp);
+        auto u = v < 0 ? 0ul - (unsigned long)v : (unsigned long)v;
+
+        do {
+                *--p = '0' + u % 10;
+                u /= 10;
+        } while (u != 0);
+
+        if (v < 0)
+                *--p = '-';
+
+        Put(p, tmp + sizeof(tmp) - p);
+        return *this;
+}
+
+void Emit::Close(void)
+{
+        if (_fd < 0)
+                return;
+
+        Flush();
+        auto fd = _fd;
+        _fd = -1;
+        if (close(fd) < 0)
+                error("could not close %s", _path.c_str());
+}
+
+Emit::~Emit()
+{
+        // a destructor must not throw; callers who care use Close()
+        try {
+                Close();
+        } catch (const CompileError &) {
+        }
+}
@@ -0,0 +1,92 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include "Error.h"
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// buffered assembly output
+//
+// text is collected in a big buffer and handed to write() only when the
+// buffer fills up or on Flush(), and integers are formatted by hand, so
+// emitting an instruction costs no stdio call and no allocation. an Emit
+// made without a path keeps everything in memory instead
+class Emit {
+private:
+        // size of output buffer for files
+        static constexpr size_t SIZE = 1 << 20;
+
+        std::string             _path;  // path name of output file
+        int                     _fd;    // output file or -1
+        std::vector<char>       _buf;   // output buffer
+        size_t                  _len;   // bytes in _buf
+
+        // append n bytes that do not fit in buffer
+        void spill(const char *s, size_t n);
+public:
+        // in-memory output
+        Emit(void);
+
+        // @path:       path name of output file
+        Emit(const std::string &path);
+
+        Emit(const Emit &) = delete;
+        Emit &operator=(const Emit &) = delete;
+
+        // write out buffered text; no-op for in-memory output
+        void Flush(void);
+
+        // drop buffered text of in-memory output
+        void Clear(void);
+
+        // write out buffered text and close file; no-op for in-memory
+        // output
+        void Close(void);
+
+        // get buffered text
+        const char *Data(void) const;
+
+        // get number of bytes buffered
+        size_t Size(void) const;
+
+        // append n bytes
+        void Put(const char *s, size_t n)
+        {
+                if (_len + n > _buf.size())
+                        return spill(s, n);
+                memcpy(_buf.data() + _len, s, n);
+                _len += n;
+        }
+
+        // append everything buffered in another Emit
+        void Put(const Emit &e)
+        {
+                if (e.Size() != 0)
+                        Put(e.Data(), e.Size());
+        }
+
+        Emit &operator<<(const char *s)
+        {
+                Put(s, strlen(s));
+                return *this;
+        }
+
+        Emit &operator<<(char c)
+        {
+                Put(&c, 1);
+                return *this;
+        }
+
+        Emit &operator<<(long v);
+
+        Emit &operator<<(int v)
+        {
+                return *this << (long)v;
+        }
+
+        ~Emit();
+};
+
+#endif
@@ -1,21 +1,33 @@
 #include "Error.h"
 
+// format "fmt: strerror(err)"
+static std::string format(int err, const char *fmt, va_list va)
+{
+        char buf[512];
+
+        vsnprintf(buf, sizeof(buf), fmt, va);
+        return std::string{buf} + ": " + strerror(err);
+}
+
+CompileError::CompileError(const std::string &msg)
+        : std::runtime_error {msg}
+{}
+
 void usage(const char *fmt, ...)
 {
         va_list va;
         va_start(va, fmt);
-        vfprintf(stderr, fmt, va);
+        auto msg = format(EINVAL, fmt, va);
         va_end(va);
-        fprintf(stderr, ": %s\n", strerror(EINVAL));
-        exit(EXIT_FAILURE);
+        throw CompileError{msg};
 }
 
 void error(const char *fmt, ...)
 {
+        auto err = errno;
         va_list va;
         va_start(va, fmt);
-        vfprintf(stderr, fmt, va);
+        auto msg = format(err, fmt, va);
         va_end(va);
-        fprintf(stderr, ": %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        throw CompileError{msg};
 }
@@ -6,6 +6,18 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <stdexcept>
+#include <string>
+
+// diagnostic thrown by usage() and error()
+//
+// nothing below main() exits the process: a driver catches this, prints
+// what() and decides what to do
+class CompileError : public std::runtime_error {
+public:
+        // @msg:        diagnostic text
+        CompileError(const std::string &msg);
+};
 
 // @fmt:        format string
 // @...:        variadic list
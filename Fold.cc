@@ -0,0 +1,278 @@
+#include "Fold.h"
+#include <cstdint>
+#include <utility>
+
+static int isconst(const AstPool &ast, AstRef n)
+{
+        return n != NIL_AST && ast[n].Type() == AST_INTLIT;
+}
+
+static int fits(int64_t v)
+{
+        return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+// turn node into an integer literal, keeping its data type
+static AstRef lit(AstPool &ast, AstRef n, int64_t v)
+{
+        auto &a = ast[n];
+
+        a.SetType(AST_INTLIT);
+        a.SetLeft(NIL_AST);
+        a.SetRight(NIL_AST);
+        a.SetInt((int)v);
+        return n;
+}
+
+// evaluate operator on constants like the generated code would,
+// returns 0 if it cannot be folded
+//
+// @op:         ast type
+// @l:          left operand
+// @r:          right operand
+// @v:          set to result
+static int eval(int op, int64_t l, int64_t r, int64_t &v)
+{
+        // registers wrap, so add, subtract and multiply must too
+        auto ul = (uint64_t)l;
+        auto ur = (uint64_t)r;
+
+        switch (op) {
+        case AST_ADD:   v = (int64_t)(ul + ur);         break;
+        case AST_SUB:   v = (int64_t)(ul - ur);         break;
+        case AST_MUL:   v = (int64_t)(ul * ur);         break;
+        case AST_DIV:
+                // leave dividing by zero to fault at run time
+                if (r == 0)
+                        return 0;
+                v = l / r;
+                break;
+        case AST_EQ:    v = l == r;     break;
+        case AST_NE:    v = l != r;     break;
+        case AST_LT:    v = l < r;      break;
+        case AST_GT:    v = l > r;      break;
+        case AST_LE:    v = l <= r;     break;
+        case AST_GE:    v = l >= r;     break;
+        default:
+                return 0;
+        }
+        return fits(v);
+}
+
+// can expression be dropped or evaluated once instead of twice?
+static int pure(const AstPool &ast, AstRef n)
+{
+        if (n == NIL_AST)
+                return 1;
+
+        auto &a = ast[n];
+
+        switch (a.Type()) {
+        case AST_CALL:
+        case AST_ASSIGN:
+                return 0;
+        case AST_IF:
+                return pure(ast, a.Left()) && pure(ast, a.Mid()) &&
+                        pure(ast, a.Right());
+        default:
+                return pure(ast, a.Left()) && pure(ast, a.Right());
+        }
+}
+
+// do expressions compute the same value?
+static int same(const AstPool &ast, AstRef m, AstRef n)
+{
+        if (m == NIL_AST || n == NIL_AST)
+                return m == n;
+
+        auto &a = ast[m];
+        auto &b = ast[n];
+
+        return a.Type() == b.Type() && a.Dtype() == b.Dtype() &&
+                a.Int() == b.Int() && a.Type() != AST_IF &&
+                same(ast, a.Left(), b.Left()) &&
+                same(ast, a.Right(), b.Right());
+}
+
+static AstRef foldExpr(AstPool &ast, AstRef n);
+
+// simplify arithmetic on folded operands
+static AstRef arith(AstPool &ast, AstRef n)
+{
+        auto &a = ast[n];
+        auto op = a.Type();
+        auto l = a.Left();
+        auto r = a.Right();
+        int64_t v;
+
+        if (isconst(ast, l) && isconst(ast, r)) {
+                if (eval(op, ast[l].Int(), ast[r].Int(), v))
+                        return lit(ast, n, v);
+                return n;
+        }
+
+        // constants of + and * go on the right, so chains line up
+        if ((op == AST_ADD || op == AST_MUL) && isconst(ast, l)) {
+                a.SetLeft(r);
+                a.SetRight(l);
+                std::swap(l, r);
+        }
+
+        // the kept operand must already have our type, or pointer
+        // arithmetic and widening would be lost
+        auto keep = ast[l].Dtype() == a.Dtype();
+
+        if (isconst(ast, r)) {
+                auto c = ast[r].Int();
+
+                switch (op) {
+                case AST_ADD:
+                case AST_SUB:
+                        if (c == 0 && keep)
+                                return l;
+                        break;
+                case AST_MUL:
+                        if (c == 1 && keep)
+                                return l;
+                        if (c == 0 && pure(ast, l))
+                                return lit(ast, n, 0);
+                        break;
+                case AST_DIV:
+                        if (c == 1 && keep)
+                                return l;
+                        break;
+                }
+
+                // (x op c1) op c2 -> x op (c1 op' c2)
+                auto &b = ast[l];
+                if (b.Dtype() == a.Dtype() && isconst(ast, b.Right())) {
+                        auto c1 = (int64_t)ast[b.Right()].Int();
+                        auto inner = b.Type();
+                        int nop {0};
+
+                        if (op == AST_MUL && inner == AST_MUL) {
+                                nop = AST_MUL;
+                                v = (int64_t)((uint64_t)c1 * (uint64_t)c);
+                        } else if ((op == AST_ADD || op == AST_SUB) &&
+                                   (inner == AST_ADD || inner == AST_SUB)) {
+                                // everything as an add of c1 +/- c
+                                auto s1 = inner == AST_ADD ? c1 : -c1;
+                                auto s2 = op == AST_ADD ? (int64_t)c : -c;
+                                nop = AST_ADD;
+                                v = s1 + s2;
+                        }
+                        if (nop && fits(v)) {
+                                a.SetType(nop);
+                                a.SetLeft(b.Left());
+                                ast[r].SetInt((int)v);
+                                return arith(ast, n);
+                        }
+                }
+                return n;
+        }
+
+        if (op == AST_SUB && same(ast, l, r) && pure(ast, l))
+                return lit(ast, n, 0);
+
+        return n;
+}
+
+// fold expression, returns node to use in its place
+static AstRef foldExpr(AstPool &ast, AstRef n)
+{
+        if (n == NIL_AST)
+                return n;
+
+        auto &a = ast[n];
+        auto l = foldExpr(ast, a.Left());
+        auto r = foldExpr(ast, a.Right());
+
+        a.SetLeft(l);
+        a.SetRight(r);
+
+        switch (a.Type()) {
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MUL:
+        case AST_DIV:
+                return arith(ast, n);
+        case AST_EQ:
+        case AST_NE:
+        case AST_LT:
+        case AST_GT:
+        case AST_LE:
+        case AST_GE: {
+                int64_t v;
+                if (isconst(ast, l) && isconst(ast, r) &&
+                    eval(ast[n].Type(), ast[l].Int(), ast[r].Int(), v))
+                        return lit(ast, n, v);
+                return n;
+        }
+        case AST_WIDEN:
+                // widening a register changes nothing but the type
+                if (isconst(ast, l))
+                        return lit(ast, n, ast[l].Int());
+                return n;
+        case AST_SCALE:
+                if (isconst(ast, l)) {
+                        auto v = (int64_t)ast[l].Int() * ast[n].Int();
+                        if (fits(v))
+                                return lit(ast, n, v);
+                }
+                return n;
+        default:
+                return n;
+        }
+}
+
+// fold operands of condition, returns 1 and sets v if it is constant
+static int foldCond(AstPool &ast, AstRef n, int64_t &v)
+{
+        auto &a = ast[n];
+
+        a.SetLeft(foldExpr(ast, a.Left()));
+        a.SetRight(foldExpr(ast, a.Right()));
+
+        // the condition itself stays a comparison for cmp_and_jmp
+        return isconst(ast, a.Left()) && isconst(ast, a.Right()) &&
+                eval(a.Type(), ast[a.Left()].Int(), ast[a.Right()].Int(), v);
+}
+
+AstRef fold(AstPool &ast, AstRef n)
+{
+        if (n == NIL_AST)
+                return n;
+
+        auto &a = ast[n];
+        int64_t v;
+
+        switch (a.Type()) {
+        case AST_FUNC:
+                a.SetLeft(fold(ast, a.Left()));
+                return n;
+        case AST_GLUE: {
+                auto l = fold(ast, a.Left());
+                auto r = fold(ast, a.Right());
+                if (l == NIL_AST)
+                        return r;
+                if (r == NIL_AST)
+                        return l;
+                a.SetLeft(l);
+                a.SetRight(r);
+                return n;
+        }
+        case AST_IF:
+                if (foldCond(ast, a.Left(), v))
+                        return fold(ast, v ? a.Mid() : a.Right());
+                a.SetMid(fold(ast, a.Mid()));
+                a.SetRight(fold(ast, a.Right()));
+                return n;
+        case AST_WHILE:
+                if (foldCond(ast, a.Left(), v) && !v)
+                        return NIL_AST;
+                a.SetRight(fold(ast, a.Right()));
+                return n;
+        default:
+                return foldExpr(ast, n);
+        }
+}
@@ -0,0 +1,20 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "Ast.h"
+
+// fold constant expressions of a function and simplify identities
+//
+// runs between the parser and the code generator. values are folded the
+// way the generated code computes them: in 64-bit registers, with
+// AST_WIDEN only changing the data type, so folding never changes what
+// a program prints. a result that does not fit an integer literal is
+// left alone. nodes are rewritten in place; nodes no longer used stay in
+// the pool until it is reset
+//
+// @ast:        nodes of function
+// @n:          root of function
+// returns new root, NIL_AST if nothing is left to generate
+extern AstRef fold(AstPool &ast, AstRef n);
+
+#endif
@@ -0,0 +1,44 @@
+#include "Synth.h"
+#include <cstdlib>
+#include <unistd.h>
+
+// write a synthetic program of a given size to standard output
+static void usage_exit(void)
+{
+        fprintf(stderr, "mycc-gen [-s seed] size[K|M|G]\n");
+        exit(1);
+}
+
+int main(int argc, char **argv)
+{
+        uint64_t seed {1};
+        int c;
+
+        while ((c = getopt(argc, argv, "s:")) != -1) {
+                switch (c) {
+                case 's':
+                        seed = strtoull(optarg, nullptr, 10);
+                        break;
+                default:
+                        usage_exit();
+                }
+        }
+        if (optind != argc - 1)
+                usage_exit();
+
+        auto size = parse_size(argv[optind]);
+        if (size == 0)
+                usage_exit();
+
+        try {
+                auto st = Synth{stdout, seed}.Write(size);
+                if (fflush(stdout) == EOF)
+                        error("could not write program");
+                fprintf(stderr, "%zu bytes, %zu lines, %zu functions\n",
+                                st.bytes, st.lines, st.funcs);
+        } catch (const CompileError &e) {
+                fprintf(stderr, "%s\n", e.what());
+                exit(EXIT_FAILURE);
+        }
+        return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 128-bit content hash
+struct Digest {
+        uint64_t        lo;     // low half
+        uint64_t        hi;     // high half
+};
+
+// streaming content hash
+//
+// two 64-bit lanes, FNV-1a and a multiply-rotate mix, each finished with
+// a splitmix64 avalanche. not cryptographic, but wide enough that
+// unrelated inputs do not collide in practice
+class Hasher {
+private:
+        uint64_t        _a;     // FNV-1a lane
+        uint64_t        _b;     // multiply-rotate lane
+
+        static uint64_t avalanche(uint64_t x)
+        {
+                x ^= x >> 30;
+                x *= 0xbf58476d1ce4e5b9ull;
+                x ^= x >> 27;
+                x *= 0x94d049bb133111ebull;
+                return x ^ (x >> 31);
+        }
+public:
+        Hasher(void)
+                : _a {14695981039346656037ull},
+                _b {0x9e3779b97f4a7c15ull}
+        {}
+
+        // @p:          bytes to add
+        // @n:          number of bytes
+        void Add(const char *p, size_t n)
+        {
+                for (size_t i = 0; i < n; i++) {
+                        uint64_t c = (unsigned char)p[i];
+                        _a = (_a ^ c) * 1099511628211ull;
+                        _b = (_b ^ c) * 0xff51afd7ed558ccdull;
+                        _b = _b << 23 | _b >> 41;
+                }
+        }
+
+        // add an integer in one step
+        //
+        // @v:          integer to add
+        void Add(uint64_t v)
+        {
+                _a = (_a ^ v) * 1099511628211ull;
+                _b = (_b ^ v) * 0xff51afd7ed558ccdull;
+                _b = _b << 23 | _b >> 41;
+        }
+
+        // get hash of everything added so far
+        Digest Sum(void) const
+        {
+                return Digest{avalanche(_a), avalanche(_b ^ _a)};
+        }
+};
+
+#endif
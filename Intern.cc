@@ -0,0 +1,173 @@
+#include "Intern.h"
+#include "Mem.h"
+
+Interner interner;
+
+Interner::Interner(void)
+{
+        for (auto &sh : _shards) {
+                sh.slots.assign(64, 0);
+                sh.size = 0;
+                sh.left = 0;
+                for (auto &c : sh.chunks)
+                        c.store(nullptr, std::memory_order_relaxed);
+        }
+}
+
+Interner::~Interner()
+{
+        for (auto &sh : _shards) {
+                for (auto &c : sh.chunks)
+                        delete[] c.load(std::memory_order_relaxed);
+        }
+}
+
+uint32_t Interner::HashOf(const char *s, size_t len)
+{
+        // FNV-1a
+        uint32_t h = 2166136261u;
+
+        for (size_t i = 0; i < len; i++) {
+                h ^= (unsigned char)s[i];
+                h *= 16777619u;
+        }
+
+        return h;
+}
+
+// split local index of an entry into chunk and offset in chunk
+static inline void chunk_of(uint32_t i, unsigned first, unsigned *chunk,
+                uint32_t *off)
+{
+        auto biased = i + (1u << first);
+        auto top = 31 - __builtin_clz(biased);
+
+        *chunk = top - first;
+        *off = biased - (1u << top);
+}
+
+const Interner::Entry &Interner::entry(Ident id) const
+{
+        unsigned chunk;
+        uint32_t off;
+
+        auto &sh = _shards[id & (NSHARDS - 1)];
+        chunk_of(id >> SHARD_BITS, CHUNK0_BITS, &chunk, &off);
+
+        return sh.chunks[chunk].load(std::memory_order_acquire)[off];
+}
+
+const char *Interner::save(Shard &sh, const char *s, size_t len)
+{
+        char *p;
+
+        if (len + 1 > NAME_BLOCK / 4) {
+                sh.blocks.emplace_back(new char[len + 1]);
+                p = sh.blocks.back().get();
+        } else {
+                if (len + 1 > sh.left) {
+                        sh.blocks.emplace_back(new char[NAME_BLOCK]);
+                        sh.left = NAME_BLOCK;
+                }
+                p = sh.blocks.back().get() + (NAME_BLOCK - sh.left);
+                sh.left -= len + 1;
+        }
+
+        memcpy(p, s, len);
+        p[len] = '\0';
+        return p;
+}
+
+Ident Interner::add(Shard &sh, unsigned shard, const char *s, size_t len,
+                uint32_t hash)
+{
+        MemTag mt {MEM_NAME};
+        unsigned chunk;
+        uint32_t off;
+
+        auto i = sh.size;
+        if (i >= (1u << (32 - SHARD_BITS)) - (1u << CHUNK0_BITS))
+                usage("too many identifiers");
+
+        chunk_of(i, CHUNK0_BITS, &chunk, &off);
+        auto c = sh.chunks[chunk].load(std::memory_order_relaxed);
+        if (c == nullptr) {
+                c = new Entry[1u << (chunk + CHUNK0_BITS)];
+                sh.chunks[chunk].store(c, std::memory_order_release);
+        }
+
+        c[off] = Entry{save(sh, s, len), (uint32_t)len, hash};
+        sh.size++;
+
+        if (sh.size * 2 > sh.slots.size())
+                grow(sh);
+
+        return (i << SHARD_BITS) | shard;
+}
+
+void Interner::grow(Shard &sh)
+{
+        std::vector<uint32_t> slots(sh.slots.size() * 2, 0);
+        auto mask = slots.size() - 1;
+
+        for (auto s : sh.slots) {
+                if (s == 0)
+                        continue;
+                auto id = ((s - 1) << SHARD_BITS) |
+                        (&sh - _shards);
+                auto j = entry(id).hash & mask;
+                while (slots[j] != 0)
+                        j = (j + 1) & mask;
+                slots[j] = s;
+        }
+
+        sh.slots.swap(slots);
+}
+
+Ident Interner::Intern(const char *s, size_t len)
+{
+        auto hash = HashOf(s, len);
+        auto shard = hash >> (32 - SHARD_BITS);
+        auto &sh = _shards[shard];
+        std::lock_guard<std::mutex> guard {sh.lock};
+        auto mask = sh.slots.size() - 1;
+
+        for (auto j = hash & mask; sh.slots[j] != 0; j = (j + 1) & mask) {
+                auto id = ((sh.slots[j] - 1) << SHARD_BITS) | shard;
+                auto &e = entry(id);
+                if (e.hash == hash && e.len == len &&
+                    memcmp(e.name, s, len) == 0)
+                        return id;
+        }
+
+        auto id = add(sh, shard, s, len, hash);
+
+        // slots may have been rehashed by add(), so probe again
+        mask = sh.slots.size() - 1;
+        auto j = hash & mask;
+        while (sh.slots[j] != 0)
+                j = (j + 1) & mask;
+        sh.slots[j] = (id >> SHARD_BITS) + 1;
+
+        return id;
+}
+
+Ident Interner::Intern(const std::string &name)
+{
+        return Intern(name.data(), name.size());
+}
+
+const char *Interner::Name(Ident id) const
+{
+        return entry(id).name;
+}
+
+size_t Interner::Len(Ident id) const
+{
+        return entry(id).len;
+}
+
+uint32_t Interner::Hash(Ident id) const
+{
+        return entry(id).hash;
+}
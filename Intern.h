@@ -0,0 +1,107 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "Error.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// interned identifier
+typedef uint32_t Ident;
+
+// identifier interner
+//
+// maps each distinct identifier to a stable 32-bit id. the table is split
+// into shards by hash, each with its own lock, so compilations running on
+// different threads can share one interner. an id, once handed out, is
+// never moved or freed, so Name()/Len()/Hash() take no lock
+class Interner {
+private:
+        // number of shards (power of 2)
+        static constexpr unsigned NSHARDS = 16;
+        static constexpr unsigned SHARD_BITS = 4;
+
+        // first entry chunk holds 1 << CHUNK0_BITS entries, each next
+        // chunk is twice as big as the one before it
+        static constexpr unsigned CHUNK0_BITS = 6;
+        static constexpr unsigned NCHUNKS = 32 - SHARD_BITS - CHUNK0_BITS;
+
+        // size of blocks that names are copied into
+        static constexpr size_t NAME_BLOCK = 1 << 16;
+
+        // interned identifier
+        struct Entry {
+                const char      *name;  // nul terminated name
+                uint32_t        len;    // length of name
+                uint32_t        hash;   // hash of name
+        };
+
+        // one shard of the table
+        struct Shard {
+                std::mutex                      lock;   // guards everything
+                                                        // but chunks
+                std::vector<uint32_t>           slots;  // open addressed:
+                                                        // local index + 1
+                uint32_t                        size;   // number of entries
+                std::atomic<Entry *>            chunks[NCHUNKS];
+                std::vector<std::unique_ptr<char[]>> blocks; // name storage
+                size_t                          left;   // bytes left in
+                                                        // last block
+        };
+
+        Shard   _shards[NSHARDS];       // shards
+
+        // get entry for id
+        const Entry &entry(Ident id) const;
+
+        // copy name into shard's name storage
+        const char *save(Shard &sh, const char *s, size_t len);
+
+        // add entry to shard, lock must be held
+        Ident add(Shard &sh, unsigned shard, const char *s, size_t len,
+                        uint32_t hash);
+
+        // double number of slots in shard, lock must be held
+        void grow(Shard &sh);
+public:
+        // default constructor
+        Interner(void);
+
+        Interner(const Interner &) = delete;
+        Interner &operator=(const Interner &) = delete;
+
+        // hash a name
+        //
+        // @s:          start of name
+        // @len:        length of name
+        static uint32_t HashOf(const char *s, size_t len);
+
+        // get id of name, adding it if it is new
+        //
+        // @s:          start of name
+        // @len:        length of name
+        Ident Intern(const char *s, size_t len);
+
+        // @name:       name
+        Ident Intern(const std::string &name);
+
+        // get nul terminated name of id
+        const char *Name(Ident id) const;
+
+        // get length of name of id
+        size_t Len(Ident id) const;
+
+        // get cached hash of id
+        uint32_t Hash(Ident id) const;
+
+        ~Interner();
+};
+
+// interner shared by every compilation in the process
+extern Interner interner;
+
+#endif
@@ -1,14 +1,122 @@
 #include "Lexer.h"
 
+// keyword
+struct Keyword {
+        const char      *word;  // keyword
+        size_t          len;    // length of keyword
+        int             type;   // token type
+};
+
+static constexpr Keyword keywords[] = {
+        {"int",         3,      TOK_INT},
+        {"if",          2,      TOK_IF},
+        {"else",        4,      TOK_ELSE},
+        {"while",       5,      TOK_WHILE},
+        {"for",         3,      TOK_FOR},
+        {"void",        4,      TOK_VOID},
+        {"char",        4,      TOK_CHAR},
+        {"long",        4,      TOK_LONG},
+        {"return",      6,      TOK_RETURN},
+};
+
+static constexpr int NKEYWORDS = sizeof(keywords) / sizeof(*keywords);
+
+// number of slots in keyword hash table (power of 2)
+static constexpr unsigned KW_SLOTS = 16;
+
+// perfect hash of keywords: first byte and length are enough to tell
+// every keyword apart
+//
+// @w:          word
+// @len:        length of word
+static constexpr unsigned kwhash(const char *w, size_t len)
+{
+        return ((unsigned char)w[0] * 4 + len) & (KW_SLOTS - 1);
+}
+
+// index of keyword with hash h, or -1 if there is none
+static constexpr int kwfind(unsigned h, int i)
+{
+        return i == NKEYWORDS ? -1 :
+                kwhash(keywords[i].word, keywords[i].len) == h ? i :
+                kwfind(h, i + 1);
+}
+
+// do keywords i and j (or any after j) share a slot?
+static constexpr bool kwclash(int i, int j)
+{
+        return i == NKEYWORDS ? false :
+                j == NKEYWORDS ? kwclash(i + 1, i + 2) :
+                kwhash(keywords[i].word, keywords[i].len) ==
+                kwhash(keywords[j].word, keywords[j].len) ? true :
+                kwclash(i, j + 1);
+}
+
+static_assert(!kwclash(0, 1), "keyword hash is not perfect");
+
+#define KW(h)   kwfind(h, 0)
+
+// keyword hash table: slot -> index into keywords or -1
+static constexpr signed char kwtab[KW_SLOTS] = {
+        KW(0),  KW(1),  KW(2),  KW(3),  KW(4),  KW(5),  KW(6),  KW(7),
+        KW(8),  KW(9),  KW(10), KW(11), KW(12), KW(13), KW(14), KW(15),
+};
+
+#undef KW
+
 Lexer::Lexer(const std::string &path)
-        : _path {path},
+        : _src {path},
+        _curr {},
+        _rej {},
+        _pos {0},
+        _toks {_src.Buf()},
+        _next {0},
+        _buffered {0},
+        _ring {},
+        _batch {nullptr},
+        _bi {0},
+        _thr {},
+        _pipelined {0},
+        _badfmt {nullptr},
+        _badc {0},
+        _hash {},
+        _hashing {0},
+        _ahead {timereport.On() ? new TokBatch{} : nullptr},
+        _ai {0}
+{}
+
+Lexer::Lexer(const std::string &name, const char *buf, size_t len)
+        : _src {name, buf, len},
         _curr {},
         _rej {},
-        _fp {fopen(path.c_str(), "r")},
-        _pc {'\0'}
+        _pos {0},
+        _toks {_src.Buf()},
+        _next {0},
+        _buffered {0},
+        _ring {},
+        _batch {nullptr},
+        _bi {0},
+        _thr {},
+        _pipelined {0},
+        _badfmt {nullptr},
+        _badc {0},
+        _hash {},
+        _hashing {0},
+        _ahead {timereport.On() ? new TokBatch{} : nullptr},
+        _ai {0}
+{}
+
+Lexer::~Lexer()
+{
+        if (_thr.joinable()) {
+                _ring->Stop();
+                _thr.join();
+        }
+}
+
+const std::string &Lexer::Path(void) const
 {
-        if (_fp == nullptr)
-                error("could not open: %s", path.c_str());
+        return _src.Path();
 }
 
 Token Lexer::Curr(void) const
@@ -18,145 +126,269 @@ Token Lexer::Curr(void) const
 
 int Lexer::nextchar(void)
 {
-        auto c = _pc;
-
-        if (c != '\0')
-                _pc = '\0';
-        else
-                c = fgetc(_fp);
+        if (_pos >= _src.Len())
+                return EOF;
 
-        if (ferror(_fp))
-                error("could not read: %s", _path.c_str());
-
-        return c;
+        return (unsigned char)_src.Buf()[_pos++];
 }
 
-std::string Lexer::readint(int c)
+void Lexer::putback(int c)
 {
-        std::string n;
+        if (c != EOF)
+                _pos--;
+}
 
-        while (isdigit(c)) {
-                n += c;
-                c = nextchar();
-        }
-        _pc = c;
+Token Lexer::tok(int type, size_t start) const
+{
+        return Token{type, _src.Buf(), start, _pos - start};
+}
 
-        return n;
+Token Lexer::readint(size_t start)
+{
+        _pos = scan_digits(_src.Buf(), _pos, _src.Len());
+        return tok(TOK_INTLIT, start);
 }
 
-std::string Lexer::readid(int c)
+Token Lexer::readid(size_t start)
 {
-        std::string w;
+        _pos = scan_ident(_src.Buf(), _pos, _src.Len());
 
-        while (isalpha(c) || isdigit(c) || c == '_') {
-                w += c;
-                c = nextchar();
-        }
-        _pc = c;
+        auto w = _src.Buf() + start;
+        auto len = _pos - start;
+        auto k = kwtab[kwhash(w, len)];
+        if (k >= 0 && keywords[k].len == len &&
+            memcmp(keywords[k].word, w, len) == 0)
+                return tok(keywords[k].type, start);
 
-        return w;
+        return Token{_src.Buf(), start, len, interner.Intern(w, len)};
 }
 
 Token Lexer::Next(void)
 {
+        // the text of keywords and operators follows from their type,
+        // and identifiers are hashed by the interner already
+        if (_hashing) {
+                uint64_t v = _curr.Type() | (uint64_t)_curr.Len() << 8;
+                if (_curr.Type() == TOK_IDENT)
+                        v |= (uint64_t)interner.Hash(_curr.Id()) << 32;
+                _hash.Add(v);
+                if (_curr.Type() == TOK_INTLIT)
+                        _hash.Add(_curr.Ptr(), _curr.Len());
+        }
+
         if (_rej.Type() != TOK_EOF) {
                 _curr = _rej;
-                _rej = Token{TOK_EOF, ""};
+                _rej = Token{};
                 return _curr;
         }
 
-        int c;
-        while ((c = nextchar()) != EOF && isspace(c))
-                ;
+        if (_pipelined)
+                return _curr = pull();
+
+        if (_ahead)
+                return _curr = next();
+        if (!_buffered)
+                return _curr = lex();
+
+        if (_next < _toks.Size())
+                return _curr = _toks.Get(_next++);
+        return _curr = _toks.Get(_toks.Size() - 1);
+}
+
+Token Lexer::Peek(size_t n) const
+{
+        if (!_buffered)
+                usage("lookahead needs pretokenized input");
+        if (n == 0)
+                return _curr;
+
+        auto i = _next - 1 + n;     // _next - 1 is current token
+        if (i >= _toks.Size())
+                i = _toks.Size() - 1;
+        return _toks.Get(i);
+}
+
+void Lexer::Tokenize(void)
+{
+        TraceSpan ts {"lex"};
+        PhaseTimer pt {PHASE_LEX};
+        Token t;
+
+        ts.Arg(_src.Path());
+
+        _ahead.reset();
+        // most tokens and the space after them take 4+ bytes of source
+        _toks.Reserve(_src.Len() / 4 + 1);
+        do {
+                t = lex();
+                _toks.Push(t);
+        } while (t.Type() != TOK_EOF);
+
+        _next = 0;
+        _buffered = 1;
+}
+
+const TokBuf &Lexer::Toks(void) const
+{
+        return _toks;
+}
+
+void Lexer::Pipeline(void)
+{
+        _ahead.reset();
+        _ring.reset(new Ring<TokBatch>{TOK_RING});
+        _pipelined = 1;
+        _thr = std::thread{&Lexer::produce, this};
+}
+
+void Lexer::produce(void)
+{
+        for (;;) {
+                auto b = _ring->Back();
+                if (b == nullptr)
+                        return;
+
+                TraceSpan ts {"lex"};
+                PhaseTimer pt {PHASE_LEX};
+                b->n = 0;
+                while (b->n < TOK_BATCH) {
+                        auto t = lex();
+                        b->toks[b->n++] = t;
+                        if (t.Type() == TOK_EOF) {
+                                _ring->Push();
+                                return;
+                        }
+                }
+                _ring->Push();
+        }
+}
+
+Token Lexer::pull(void)
+{
+        if (_batch == nullptr)
+                _batch = _ring->Front();
+
+        auto t = _batch->toks[_bi];
+        if (t.Type() == TOK_EOF) {
+                // stay on EOF like the other modes
+                if (_badfmt != nullptr)
+                        usage(_badfmt, _badc);
+                return t;
+        }
+
+        if (++_bi == _batch->n) {
+                _ring->Pop();
+                _batch = nullptr;
+                _bi = 0;
+        }
+
+        return t;
+}
+
+Token Lexer::bad(const char *fmt, int c)
+{
+        if (!_pipelined && !_ahead)
+                usage(fmt, c);
+
+        _badfmt = fmt;
+        _badc = c;
+        return tok(TOK_EOF, _pos);
+}
+
+Token Lexer::next(void)
+{
+        if (_ai == _ahead->n) {
+                PhaseTimer pt {PHASE_LEX};
+                Token t;
+
+                _ahead->n = 0;
+                _ai = 0;
+                do {
+                        t = lex();
+                        _ahead->toks[_ahead->n++] = t;
+                } while (_ahead->n < TOK_BATCH && t.Type() != TOK_EOF);
+        }
+
+        auto t = _ahead->toks[_ai];
+        if (t.Type() == TOK_EOF) {
+                // stay on EOF like the other modes
+                if (_badfmt != nullptr)
+                        usage(_badfmt, _badc);
+                return t;
+        }
+        _ai++;
+        return t;
+}
+
+Token Lexer::lex(void)
+{
+        _pos = scan_space(_src.Buf(), _pos, _src.Len());
+        auto c = nextchar();
+
+        auto start = _pos - (c != EOF);
 
         switch (c) {
         case EOF:
-                return _curr = Token{TOK_EOF, ""};
+                return tok(TOK_EOF, _pos);
         case '+':
-                return _curr = Token{TOK_PLUS, "+"};
+                return tok(TOK_PLUS, start);
         case '-':
-                return _curr = Token{TOK_MINUS, "-"};
+                return tok(TOK_MINUS, start);
         case '*':
-                return _curr = Token{TOK_STAR, "*"};
+                return tok(TOK_STAR, start);
         case '/':
-                return _curr = Token{TOK_SLASH, "/"};
+                return tok(TOK_SLASH, start);
         case '=':
-                if ((c = nextchar()) == '=') {
-                        return _curr = Token{TOK_EQ, "=="};
-                }
-                _pc = c;
-                return _curr = Token{TOK_ASSIGN, "="};
+                if ((c = nextchar()) == '=')
+                        return tok(TOK_EQ, start);
+                putback(c);
+                return tok(TOK_ASSIGN, start);
         case '!':
                 if ((c = nextchar()) == '=')
-                        return _curr = Token{TOK_NE, "!="};
-                usage("bad character: %c", c);
+                        return tok(TOK_NE, start);
+                return bad("bad character: %c", c);
         case '<':
                 if ((c = nextchar()) == '=')
-                        return _curr = Token{TOK_LE, "<="};
-                _pc = c;
-                return _curr = Token{TOK_LT, "<"};
+                        return tok(TOK_LE, start);
+                putback(c);
+                return tok(TOK_LT, start);
         case '>':
                 if ((c = nextchar()) == '=')
-                        return _curr = Token{TOK_GE, ">="};
-                _pc = c;
-                return _curr = Token{TOK_GT, ">"};
+                        return tok(TOK_GE, start);
+                putback(c);
+                return tok(TOK_GT, start);
         case ';':
-                return _curr = Token{TOK_SEMI, ";"};
+                return tok(TOK_SEMI, start);
         case '{':
-                return _curr = Token{TOK_LBRACE, "{"};
+                return tok(TOK_LBRACE, start);
         case '}':
-                return _curr = Token{TOK_RBRACE, "}"};
+                return tok(TOK_RBRACE, start);
         case '(':
-                return _curr = Token{TOK_LPAREN, "("};
+                return tok(TOK_LPAREN, start);
         case ')':
-                return _curr = Token{TOK_RPAREN, ")"};
+                return tok(TOK_RPAREN, start);
+        case '[':
+                return tok(TOK_LBRACK, start);
+        case ']':
+                return tok(TOK_RBRACK, start);
         case '&':
                 if ((c = nextchar()) == '&')
-                        return _curr = Token{TOK_LOGAND, "&&"};
-                _pc = c;
-                return _curr = Token{TOK_AMPER, "&"};
+                        return tok(TOK_LOGAND, start);
+                putback(c);
+                return tok(TOK_AMPER, start);
         case ',':
-                return _curr = Token{TOK_COMMA, ","};
+                return tok(TOK_COMMA, start);
         }
 
-        if (isdigit(c)) {
-                auto n = readint(c);
-                return _curr = Token{TOK_INTLIT, n};
-        } else if (isalpha(c) || c == '_') {
-                auto w = readid(c);
-
-                if (w == "int")
-                        return _curr = Token{TOK_INT, w};
-                if (w == "if")
-                        return _curr = Token{TOK_IF, w};
-                if (w == "else")
-                        return _curr = Token{TOK_ELSE, w};
-                if (w == "while")
-                        return _curr = Token{TOK_WHILE, w};
-                if (w == "for")
-                        return _curr = Token{TOK_FOR, w};
-                if (w == "void")
-                        return _curr = Token{TOK_VOID, w};
-                if (w == "char")
-                        return _curr = Token{TOK_CHAR, w};
-                if (w == "long")
-                        return _curr = Token{TOK_LONG, w};
-                if (w == "return")
-                        return _curr = Token{TOK_RETURN, w};
-
-                return _curr = Token{TOK_IDENT, w};
+        if (char_class[c] & CC_DIGIT) {
+                return readint(start);
+        } else if (char_class[c] & CC_ALPHA) {
+                return readid(start);
         } else {
-                usage("invalid character: %c", c);
-                exit(1);
+                return bad("invalid character: %c", c);
         }
 }
 
-Lexer::~Lexer()
-{
-        if (fclose(_fp) < 0)
-                error("could not close %s", _path.c_str());
-}
-
 void Lexer::Eat(int type)
 {
         if (_curr.Type() == type) {
@@ -167,6 +399,17 @@ void Lexer::Eat(int type)
                         _curr.Name().c_str());
 }
 
+void Lexer::StartHash(void)
+{
+        _hash = Hasher{};
+        _hashing = 1;
+}
+
+Digest Lexer::TokHash(void) const
+{
+        return _hash.Sum();
+}
+
 void Lexer::Reject(Token tok)
 {
         if (_rej.Type() != TOK_EOF)
@@ -2,45 +2,133 @@
 #define LEXER_H
 
 #include "Error.h"
+#include "Hash.h"
+#include "Ring.h"
+#include "Scan.h"
+#include "Source.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "TokBuf.h"
 #include "Token.h"
 #include <cctype>
 #include <cstdio>
+#include <memory>
 #include <string>
+#include <thread>
+
+// number of tokens passed from lexer thread to parser at a time
+#define TOK_BATCH       256
+
+// number of batches the lexer thread may run ahead of the parser
+#define TOK_RING        64
+
+// batch of tokens
+struct TokBatch {
+        Token   toks[TOK_BATCH];        // tokens
+        size_t  n;                      // number of tokens
+};
 
 // lexical analyzer
 class Lexer {
 private:
-        std::string     _path;  // path name of file being read
+        Source          _src;   // whole input file
         Token           _curr;  // current token
         Token           _rej;   // rejected token
-        FILE            *_fp;   // FILE to read from
-        int             _pc;    // putback character
+        size_t          _pos;   // offset of next char in _src
+        TokBuf          _toks;  // pretokenized input
+        size_t          _next;  // index of next token in _toks
+        int             _buffered;// reading from _toks?
+        std::unique_ptr<Ring<TokBatch>> _ring;  // batches from lexer thread
+        TokBatch        *_batch;// batch being read
+        size_t          _bi;    // index of next token in _batch
+        std::thread     _thr;   // lexer thread
+        int             _pipelined;// reading from lexer thread?
+        const char      *_badfmt;// error seen by lexer thread
+        int             _badc;  // character that caused _badfmt
+        Hasher          _hash;  // hash of tokens passed since StartHash()
+        int             _hashing;// hashing tokens?
+        std::unique_ptr<TokBatch> _ahead;// tokens lexed ahead, or null
+        size_t          _ai;    // index of next token in _ahead
 
         // get next char from input
         int nextchar(void);
 
+        // put back last char read from input
+        void putback(int c);
+
+        // make a token spanning from start to current position
+        Token tok(int type, size_t start) const;
+
         // read an integer literal
-        std::string readint(int c);
+        Token readint(size_t start);
+
+        // read an identifier or keyword
+        Token readid(size_t start);
+
+        // scan next token from source buffer
+        Token lex(void);
+
+        // report bad character, or save it for the parser if we are
+        // running on the lexer thread or lexing ahead
+        Token bad(const char *fmt, int c);
+
+        // lexer thread: fill batches until end of input
+        void produce(void);
+
+        // get next token from lexer thread
+        Token pull(void);
 
-        // read an identifier
-        std::string readid(int c);
+        // get next token, lexing a batch ahead when we run out. used
+        // when timing, so the lexer is timed once per batch and not once
+        // per token
+        Token next(void);
 public:
         // @path:       path name of file to read
         Lexer(const std::string &path);
 
+        // @name:       name to report input by
+        // @buf:        source text, copied
+        // @len:        length of source text
+        Lexer(const std::string &name, const char *buf, size_t len);
+
+        // get path name of input
+        const std::string &Path(void) const;
+
         // get current token
         Token Curr(void) const;
 
         // get next token
         Token Next(void);
 
+        // look ahead in pretokenized input, 0 is current token
+        //
+        // @n:          number of tokens past current token
+        Token Peek(size_t n) const;
+
+        // tokenize whole input up front; must be called before Next()
+        void Tokenize(void);
+
+        // get pretokenized input
+        const TokBuf &Toks(void) const;
+
+        // lex on a separate thread from now on; must be called before
+        // Next()
+        void Pipeline(void);
+
+        ~Lexer();
+
         // skip if token type is type or error out
         void Eat(int type);
 
         // add token back into input
         void Reject(Token tok);
 
-        ~Lexer();
+        // hash tokens from the current one on
+        void StartHash(void);
+
+        // get hash of tokens from StartHash() up to, but not including,
+        // the current one
+        Digest TokHash(void) const;
 };
 
 #endif
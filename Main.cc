@@ -1,21 +1,268 @@
-#include "CodeGen.h"
-#include "Lexer.h"
-#include "Parser.h"
+#include "Compiler.h"
+#include "Mem.h"
+#include "Peephole.h"
+#include "Pool.h"
+#include "Server.h"
+#include "Timer.h"
+#include "Trace.h"
+#include <atomic>
 #include <cstdio>
+#include <getopt.h>
+
+// command line options
+struct Options {
+        int     pretokenize;    // lex whole input up front?
+        int     tokstats;       // report token buffer?
+        int     pipeline;       // lex on its own thread?
+        int     aststats;       // report ast pool?
+        int     cgthreads;      // back end threads or 0
+        int     opt;            // optimization level
+        Cache   *cache;         // function cache or null
+};
+
+static void usage_exit(void)
+{
+        fprintf(stderr, "a.out [--pretokenize | --pipeline] [--token-stats] "
+                        "[--ast-stats] [--cg-threads=n] [--cache=dir] "
+                        "[--cache-stats] [--time-report[=file]] [--mem-report] "
+                        "[--trace=file] [--peephole-stats] [-O level] "
+                        "input\n"
+                        "a.out [options] [-j n] input...\n"
+                        "a.out --server=socket\n");
+        exit(1);
+}
+
+// get output path for input in batch mode: foo.c -> foo.s
+static std::string out_path(const std::string &in)
+{
+        auto n = in.size();
+
+        if (n > 2 && in[n - 2] == '.' && in[n - 1] == 'c')
+                n -= 2;
+        return in.substr(0, n) + ".s";
+}
+
+// print time report to stderr, or as JSON to a file
+//
+// @path:       path name of JSON file or null
+static void time_report(const char *path)
+{
+        if (path == nullptr) {
+                timereport.Print(stderr);
+                return;
+        }
+
+        auto fp = fopen(path, "w");
+        if (fp == nullptr)
+                error("could not open %s", path);
+        timereport.Json(fp);
+        if (fclose(fp) == EOF)
+                error("could not write %s", path);
+}
+
+// write trace to a file
+//
+// @path:       path name of JSON file
+static void write_trace(const char *path)
+{
+        auto fp = fopen(path, "w");
+
+        if (fp == nullptr)
+                error("could not open %s", path);
+        trace.Write(fp);
+        if (fclose(fp) == EOF)
+                error("could not write %s", path);
+}
+
+// @in:         path name of input
+// @out:        path name of output
+// @o:          options
+static void compile(const std::string &in, const std::string &out,
+                const Options &o)
+{
+        Compiler c {in, out};
+
+        if (o.pretokenize)
+                c.Lex().Tokenize();
+        if (o.pipeline)
+                c.Lex().Pipeline();
+        if (o.tokstats)
+                c.Lex().Toks().Report(stderr);
+        if (o.cgthreads)
+                c.Gen().Parallel(o.cgthreads);
+        if (o.cache)
+                c.Gen().SetCache(o.cache);
+        c.Gen().SetOpt(o.opt);
+
+        c.Run();
+        if (o.aststats)
+                c.Nodes().Report(stderr);
+}
 
 int main(int argc, char **argv)
 {
-        if (argc != 2) {
-                fprintf(stderr, "a.out input\n");
-                exit(1);
+        static const struct option opts[] = {
+                {"pretokenize", no_argument, nullptr, 'p'},
+                {"token-stats", no_argument, nullptr, 's'},
+                {"pipeline",    no_argument, nullptr, 'P'},
+                {"ast-stats",   no_argument, nullptr, 'a'},
+                {"cg-threads",  required_argument, nullptr, 'c'},
+                {"server",      required_argument, nullptr, 'S'},
+                {"cache",       required_argument, nullptr, 'C'},
+                {"cache-stats", no_argument, nullptr, 'R'},
+                {"time-report", optional_argument, nullptr, 'T'},
+                {"mem-report",  no_argument, nullptr, 'M'},
+                {"trace",       required_argument, nullptr, 't'},
+                {"peephole-stats", no_argument, nullptr, 'H'},
+                {nullptr,       0,           nullptr, 0},
+        };
+        Options o {};
+        const char *server {nullptr};
+        const char *cachedir {nullptr};
+        int cachestats {0};
+        int timing {0};
+        const char *timefile {nullptr};
+        int memstats {0};
+        const char *tracefile {nullptr};
+        int jobs {0};
+        int c;
+
+        o.opt = 1;
+        while ((c = getopt_long(argc, argv, "j:O:", opts, nullptr)) != -1) {
+                switch (c) {
+                case 'p':
+                        o.pretokenize = 1;
+                        break;
+                case 's':
+                        o.pretokenize = 1;
+                        o.tokstats = 1;
+                        break;
+                case 'P':
+                        o.pipeline = 1;
+                        break;
+                case 'a':
+                        o.aststats = 1;
+                        break;
+                case 'c':
+                        o.cgthreads = atoi(optarg);
+                        if (o.cgthreads <= 0)
+                                usage_exit();
+                        break;
+                case 'S':
+                        server = optarg;
+                        break;
+                case 'C':
+                        cachedir = optarg;
+                        break;
+                case 'R':
+                        cachestats = 1;
+                        break;
+                case 'T':
+                        timing = 1;
+                        timefile = optarg;
+                        timereport.Enable();
+                        break;
+                case 'M':
+                        // phases come from the timers
+                        memstats = 1;
+                        timereport.Enable();
+                        memreport.Enable();
+                        break;
+                case 't':
+                        tracefile = optarg;
+                        trace.Enable();
+                        break;
+                case 'H':
+                        peepstats.Enable();
+                        break;
+                case 'j':
+                        jobs = atoi(optarg);
+                        if (jobs <= 0)
+                                usage_exit();
+                        break;
+                case 'O':
+                        o.opt = atoi(optarg);
+                        if (o.opt < 0)
+                                usage_exit();
+                        break;
+                default:
+                        usage_exit();
+                }
         }
 
-        Lexer l {argv[1]};
-        CodeGen cg {"out.s"};
-        Parser p {l, cg};
+        if ((server && optind != argc) || (!server && optind == argc))
+                usage_exit();
+        if (o.pipeline && o.pretokenize)
+                usage_exit();
+        if (cachestats && !cachedir)
+                usage_exit();
+
+        std::unique_ptr<Cache> cache;
 
-        cg.SetGlo(TYPE_CHAR, STYPE_FUNC, 0, "printint");
+        try {
+                if (server)
+                        Server{server}.Run();
+
+                if (cachedir) {
+                        cache.reset(new Cache{cachedir});
+                        o.cache = cache.get();
+                }
+
+                // one input and no -j: compile to out.s as always
+                if (optind == argc - 1 && !jobs) {
+                        compile(argv[optind], "out.s", o);
+                        if (cache)
+                                cache->Save();
+                        if (cachestats)
+                                cache->Report(stderr);
+                        if (timing)
+                                time_report(timefile);
+                        if (memstats)
+                                memreport.Print(stderr);
+                        if (tracefile)
+                                write_trace(tracefile);
+                        if (peepstats.On())
+                                peepstats.Print(stderr);
+                        return 0;
+                }
+        } catch (const CompileError &e) {
+                fprintf(stderr, "%s\n", e.what());
+                exit(EXIT_FAILURE);
+        }
+
+        Pool pool {jobs ? (size_t)jobs : 1};
+        std::atomic<int> failed {0};
+
+        for (int i = optind; i < argc; i++) {
+                std::string in {argv[i]};
+                pool.Submit([in, &o, &failed]() {
+                        try {
+                                compile(in, out_path(in), o);
+                        } catch (const CompileError &e) {
+                                fprintf(stderr, "%s: %s\n", in.c_str(),
+                                                e.what());
+                                failed = 1;
+                        }
+                });
+        }
+        pool.Wait();
+        try {
+                if (cache)
+                        cache->Save();
+                if (timing)
+                        time_report(timefile);
+                if (memstats)
+                        memreport.Print(stderr);
+                if (tracefile)
+                        write_trace(tracefile);
+                if (peepstats.On())
+                        peepstats.Print(stderr);
+        } catch (const CompileError &e) {
+                fprintf(stderr, "%s\n", e.what());
+                failed = 1;
+        }
+        if (cachestats)
+                cache->Report(stderr);
 
-        cg.GenPre();
-        p.ParseDecls();
+        return failed ? EXIT_FAILURE : 0;
 }
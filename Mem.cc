@@ -0,0 +1,127 @@
+#include "Mem.h"
+#include <algorithm>
+
+MemReport memreport;
+
+thread_local int mem_tag;
+
+// counts of this thread, for charging functions
+static thread_local uint64_t thread_allocs;
+static thread_local uint64_t thread_bytes;
+
+static const char *mem_names[NMEMS] = {
+        "other", "token", "ast", "sym", "name", "gen",
+};
+
+static void add(MemCount &c, size_t n)
+{
+        c.allocs.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(n, std::memory_order_relaxed);
+
+        auto live = c.live.fetch_add(n, std::memory_order_relaxed) + n;
+        auto peak = c.peak.load(std::memory_order_relaxed);
+        while (live > peak && !c.peak.compare_exchange_weak(peak, live,
+                                std::memory_order_relaxed)) {
+        }
+}
+
+static void sub(MemCount &c, size_t n)
+{
+        c.live.fetch_sub(n, std::memory_order_relaxed);
+}
+
+MemReport::MemReport(void)
+        : _on {0},
+        _counts {},
+        _phases {},
+        _total {}
+{}
+
+void MemReport::Enable(void)
+{
+        _on.store(1, std::memory_order_relaxed);
+}
+
+uint32_t MemReport::Alloc(size_t n)
+{
+        auto mem = mem_tag;
+        auto phase = timed_phase();
+
+        add(_counts[mem][phase], n);
+        add(_phases[phase], n);
+        add(_total, n);
+        thread_allocs++;
+        thread_bytes += n;
+
+        return 1 + mem * NPHASES + phase;
+}
+
+void MemReport::Free(uint32_t tag, size_t n)
+{
+        auto mem = (tag - 1) / NPHASES;
+        auto phase = (tag - 1) % NPHASES;
+
+        sub(_counts[mem][phase], n);
+        sub(_phases[phase], n);
+        sub(_total, n);
+}
+
+uint64_t MemReport::ThreadAllocs(void)
+{
+        return thread_allocs;
+}
+
+uint64_t MemReport::ThreadBytes(void)
+{
+        return thread_bytes;
+}
+
+void MemReport::print(FILE *fp, const char *phase, const char *mem,
+                const MemCount &c)
+{
+        fprintf(fp, "  %-6s %-6s %10llu %14llu %14llu\n", phase, mem,
+                        (unsigned long long)c.allocs.load(),
+                        (unsigned long long)c.bytes.load(),
+                        (unsigned long long)c.peak.load());
+}
+
+void MemReport::Print(FILE *fp)
+{
+        int phases[NPHASES];
+        int mems[NMEMS];
+
+        for (int i = 0; i < NPHASES; i++)
+                phases[i] = i;
+        std::stable_sort(phases, phases + NPHASES, [this](int a, int b) {
+                return _phases[a].bytes.load() > _phases[b].bytes.load();
+        });
+
+        fprintf(fp, "memory report:\n"
+                    "  %-6s %-6s %10s %14s %14s\n",
+                    "phase", "memory", "allocs", "bytes", "peak live");
+        for (auto p : phases) {
+                if (_phases[p].allocs.load() == 0)
+                        continue;
+                print(fp, phase_name(p), "all", _phases[p]);
+
+                for (int i = 0; i < NMEMS; i++)
+                        mems[i] = i;
+                std::stable_sort(mems, mems + NMEMS, [this, p](int a, int b) {
+                        return _counts[a][p].bytes.load() >
+                                _counts[b][p].bytes.load();
+                });
+                for (auto m : mems) {
+                        if (_counts[m][p].allocs.load() != 0)
+                                print(fp, "", mem_names[m], _counts[m][p]);
+                }
+        }
+        print(fp, "all", "all", _total);
+
+        FuncTimes f;
+        if (timereport.Biggest(f)) {
+                fprintf(fp, "largest function: %s, %llu allocs, "
+                                "%llu bytes\n", interner.Name(f.name),
+                                (unsigned long long)f.allocs,
+                                (unsigned long long)f.bytes);
+        }
+}
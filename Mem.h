@@ -0,0 +1,115 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include "Timer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// subsystems allocations are charged to by --mem-report
+enum {
+        MEM_OTHER,      // untagged
+        MEM_TOKEN,      // tokens and their text
+        MEM_AST,        // ast nodes
+        MEM_SYM,        // symbols and symbol tables
+        MEM_NAME,       // interned identifiers
+        MEM_GEN,        // code generator and generated code
+        NMEMS,
+};
+
+// allocations of one subsystem or phase
+struct MemCount {
+        std::atomic<uint64_t>   allocs; // number of allocations
+        std::atomic<uint64_t>   bytes;  // bytes allocated
+        std::atomic<uint64_t>   live;   // bytes not yet freed
+        std::atomic<uint64_t>   peak;   // most bytes live at once
+};
+
+// allocation report
+//
+// global new and delete are replaced in the compiler (Alloc.cc) so
+// every block remembers its size and the subsystem and phase it was
+// allocated in. the subsystem is set by MemTag scopes and the phase by
+// the same timers as --time-report. without Alloc.cc nothing is counted
+class MemReport {
+private:
+        std::atomic<int>        _on;                    // counting?
+        MemCount                _counts[NMEMS][NPHASES];// by both
+        MemCount                _phases[NPHASES];       // by phase
+        MemCount                _total;                 // everything
+
+        // print counts
+        static void print(FILE *fp, const char *phase, const char *mem,
+                        const MemCount &c);
+public:
+        MemReport(void);
+
+        MemReport(const MemReport &) = delete;
+        MemReport &operator=(const MemReport &) = delete;
+
+        // start counting
+        void Enable(void);
+
+        // counting?
+        int On(void) const
+        {
+                return _on.load(std::memory_order_relaxed);
+        }
+
+        // count an allocation on this thread, returns tag to Free() it by
+        //
+        // @n:          bytes allocated
+        uint32_t Alloc(size_t n);
+
+        // count a free
+        //
+        // @tag:        tag returned by Alloc()
+        // @n:          bytes allocated
+        void Free(uint32_t tag, size_t n);
+
+        // get number of allocations made on this thread
+        static uint64_t ThreadAllocs(void);
+
+        // get bytes allocated on this thread
+        static uint64_t ThreadBytes(void);
+
+        // print counts for each phase, biggest first, and the function
+        // that allocated the most
+        //
+        // @fp:         file to print to
+        void Print(FILE *fp);
+};
+
+// report shared by every compilation in the process
+extern MemReport memreport;
+
+// subsystem allocations on this thread are charged to
+extern thread_local int mem_tag;
+
+// charges allocations on this thread to a subsystem until destroyed
+class MemTag {
+private:
+        int     _prev;  // subsystem before, or -1 if not counting
+public:
+        // @tag:        subsystem
+        MemTag(int tag)
+                : _prev {-1}
+        {
+                if (memreport.On()) {
+                        _prev = mem_tag;
+                        mem_tag = tag;
+                }
+        }
+
+        MemTag(const MemTag &) = delete;
+        MemTag &operator=(const MemTag &) = delete;
+
+        ~MemTag()
+        {
+                if (_prev >= 0)
+                        mem_tag = _prev;
+        }
+};
+
+#endif
@@ -0,0 +1,18 @@
+#include "Compiler.h"
+#include "Mycc.h"
+
+int mycc_compile(const char *name, const char *src, size_t len,
+                std::string &out, std::string &err)
+{
+        try {
+                Compiler c {name, src, len};
+                c.Run();
+                out.assign(c.Out().Data(), c.Out().Size());
+                err.clear();
+                return 0;
+        } catch (const CompileError &e) {
+                out.clear();
+                err = e.what();
+                return -1;
+        }
+}
@@ -0,0 +1,23 @@
+#ifndef MYCC_H
+#define MYCC_H
+
+#include <cstddef>
+#include <string>
+
+// libmycc: compile without touching the filesystem or exiting
+//
+// calls may be made from any number of threads at once. identifiers are
+// interned process wide, so repeated compiles of similar code get faster
+
+// compile source text into assembly
+//
+// @name:       name to report input by
+// @src:        source text
+// @len:        length of source text
+// @out:        set to generated assembly
+// @err:        set to diagnostic on failure
+// @return:     0 on success, -1 on failure
+extern int mycc_compile(const char *name, const char *src, size_t len,
+                std::string &out, std::string &err);
+
+#endif
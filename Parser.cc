@@ -1,7 +1,5 @@
 #include "Parser.h"
 
-std::string func_id;
-
 static int tok2prim(Lexer &lex, int tok)
 {
         int type;
@@ -31,41 +29,50 @@ static int tok2prim(Lexer &lex, int tok)
 
 Parser::Parser(Lexer &lex, CodeGen &cg)
         : _cg {cg},
-        _lex {lex}
+        _lex {lex},
+        _ast {},
+        _func {0},
+        _frame {0},
+        _frameSize {0}
 {
         _lex.Next();
 }
 
-Ast *Parser::ParseCompound(void)
+AstRef Parser::ParseCompound(void)
 {
-        Ast *left {nullptr};
-        Ast *tree;
+        AstRef left {NIL_AST};
+        AstRef tree;
+        auto frame = _frame;
 
+        // a block's locals go out of scope at its end, and later blocks
+        // reuse their room in the frame
         _lex.Eat(TOK_LBRACE);
+        _cg.OpenScope();
 
         for (;;) {
                 tree = parseSingle();
 
-                if (tree != nullptr) {
-                        if (tree->Type() == AST_ASSIGN ||
-                            tree->Type() == AST_RETURN ||
-                            tree->Type() == AST_CALL) {
+                if (tree != NIL_AST) {
+                        if (_ast[tree].Type() == AST_ASSIGN ||
+                            _ast[tree].Type() == AST_RETURN ||
+                            _ast[tree].Type() == AST_CALL) {
                                 _lex.Eat(TOK_SEMI);
                         }
                 }
 
-                if (tree == nullptr)
+                if (tree == NIL_AST)
                         continue;
 
-                if (left == nullptr) {
+                if (left == NIL_AST) {
                         left = tree;
                 } else {
-                        left = new Ast{AST_GLUE, TYPE_NONE,
-                                left, nullptr, tree, 0};
+                        left = _ast.New(AST_GLUE, TYPE_NONE, left, tree, 0);
                 }
 
                 if (_lex.Curr().Type() == TOK_RBRACE) {
                         _lex.Eat(TOK_RBRACE);
+                        _cg.CloseScope();
+                        _frame = frame;
                         return left;
                 }
         }
@@ -73,24 +80,26 @@ Ast *Parser::ParseCompound(void)
         return tree;
 }
 
-Ast *Parser::parsePrimary(void)
+AstRef Parser::parsePrimary(void)
 {
         Sym *s;
-        Ast *n;
-        std::string id;
+        AstRef n;
+        Ident id;
         int i;
 
         switch (_lex.Curr().Type()) {
         case TOK_INTLIT:
                 i = atoi(_lex.Curr().Lex().c_str());
                 if (i >= 0 && i < 256)
-                        n = new Ast{AST_INTLIT, TYPE_CHAR, i};
+                        n = _ast.New(AST_INTLIT, TYPE_CHAR,
+                                        NIL_AST, NIL_AST, i);
                 else
-                        n = new Ast{AST_INTLIT, TYPE_INT, i};
+                        n = _ast.New(AST_INTLIT, TYPE_INT,
+                                        NIL_AST, NIL_AST, i);
                 _lex.Next();
                 break;
         case TOK_IDENT:
-                id = _lex.Curr().Lex();
+                id = _lex.Curr().Id();
                 _lex.Eat(TOK_IDENT);
 
                 if (_lex.Curr().Type() == TOK_LPAREN)
@@ -100,7 +109,13 @@ Ast *Parser::parsePrimary(void)
                         return parseArrIdx(id);
 
                 s = _cg.GetGlo(id);
-                n = new Ast{AST_IDENT, s->Prim(), s->Name()};
+                // an array on its own is the address of its first element
+                if (s->Stype() == STYPE_ARR)
+                        n = _ast.New(AST_ADDR, s->Prim(), NIL_AST, NIL_AST,
+                                        s->Ref());
+                else
+                        n = _ast.New(AST_IDENT, s->Prim(), NIL_AST, NIL_AST,
+                                        s->Ref());
                 break;
         case TOK_LPAREN:
                 _lex.Eat(TOK_LPAREN);
@@ -162,17 +177,17 @@ static int op_prec(int type)
         return p;
 }
 
-Ast *Parser::parseExpr(int ptp)
+AstRef Parser::parseExpr(int ptp)
 {
         auto left = parsePrefix();
         auto tt = _lex.Curr().Type();
         if (tt == TOK_SEMI || tt == TOK_RPAREN || tt == TOK_RBRACK) {
-                left->SetRval(1);
+                _ast[left].SetRval(1);
                 return left;
         }
 
         while (op_prec(tt) > ptp || (right_assoc(tt) && op_prec(tt) == ptp)) {
-                Ast *ltmp, *rtmp;
+                AstRef ltmp, rtmp;
 
                 _lex.Next();
                 auto right = parseExpr(op_prec(tt));
@@ -180,74 +195,97 @@ Ast *Parser::parseExpr(int ptp)
                 auto asttype = bin_ast_op(tt);
 
                 if (asttype == AST_ASSIGN) {
-                        right->SetRval(1);
-                        right = modify_type(_cg, right, left->Dtype(), 0);
-                        if (left == nullptr)
+                        _ast[right].SetRval(1);
+                        right = modify_type(_cg, _ast, right,
+                                        _ast[left].Dtype(), 0);
+                        if (left == NIL_AST)
                                 usage("incompatible expression in assignment");
 
                         ltmp = left;
                         left = right;
                         right = ltmp;
                 } else {
-                        left->SetRval(1);
-                        right->SetRval(1);
-
-                        ltmp = modify_type(_cg, left, right->Dtype(), asttype);
-                        rtmp = modify_type(_cg, right, left->Dtype(), asttype);
-                        if (ltmp == nullptr && rtmp == nullptr) {
+                        _ast[left].SetRval(1);
+                        _ast[right].SetRval(1);
+
+                        ltmp = modify_type(_cg, _ast, left,
+                                        _ast[right].Dtype(), asttype);
+                        rtmp = modify_type(_cg, _ast, right,
+                                        _ast[left].Dtype(), asttype);
+                        if (ltmp == NIL_AST && rtmp == NIL_AST) {
                                 puts("parseExpr()");
                                 usage("incompatible types");
                         }
 
-                        if (ltmp != nullptr)
+                        if (ltmp != NIL_AST)
                                 left = ltmp;
-                        if (rtmp != nullptr)
+                        if (rtmp != NIL_AST)
                                 right = rtmp;
 
                 }
 
-                left = new Ast{bin_ast_op(tt), left->Dtype(), left, right, 0};
+                left = _ast.New(bin_ast_op(tt), _ast[left].Dtype(),
+                                left, right, 0);
                 tt = _lex.Curr().Type();
                 if (tt == TOK_SEMI || tt == TOK_RPAREN || tt == TOK_RBRACK) {
-                        left->SetRval(1);
+                        _ast[left].SetRval(1);
                         return left;
                 }
         }
 
-        left->SetRval(1);
+        _ast[left].SetRval(1);
         return left;
 }
 
-void Parser::parseVarDecl(int type, const std::string& id)
+void Parser::declVar(int prim, int stype, Ident id, int n, int local)
+{
+        auto type = stype == STYPE_ARR ? ptr_to(prim) : prim;
+
+        if (!local) {
+                _cg.GenGlo(_cg.SetGlo(type, stype, 0, id, n));
+                return;
+        }
+
+        // locals go down from %rbp, each aligned to the size of its
+        // elements
+        int size = _cg.PrimSize(prim);
+        int len = stype == STYPE_ARR ? n : 1;
+
+        if (len > (INT_MAX / 2 - _frame) / size)
+                usage("%s does not fit in the frame", interner.Name(id));
+
+        _frame = (_frame + size - 1) / size * size + size * len;
+        if (_frame > _frameSize)
+                _frameSize = _frame;
+        _cg.SetGlo(type, stype, 0, id, n)->SetOff(-_frame);
+}
+
+void Parser::parseVarDecl(int type, Ident id, int local)
 {
-        auto ident = std::string{id};
+        auto ident = id;
 
         for (;;) {
                 if (_lex.Curr().Type() == TOK_LBRACK) {
                         _lex.Eat(TOK_LBRACK);
-                        if (_lex.Curr().Type() == TOK_INTLIT) {
-                                _cg.SetGlo(ptr_to(type), STYPE_ARR,
-                                        0, ident,
-                                        atoi(_lex.Curr().Lex().c_str()));
-                                _cg.GenGlo(ident);
-                        }
+                        if (_lex.Curr().Type() != TOK_INTLIT)
+                                usage("array size of %s is not a literal",
+                                                interner.Name(ident));
+                        auto n = atoi(_lex.Curr().Lex().c_str());
+                        if (n <= 0)
+                                usage("invalid array size: %d", n);
                         _lex.Next();
                         _lex.Eat(TOK_RBRACK);
-                        if (_lex.Curr().Type() == TOK_SEMI) {
-                                _lex.Eat(TOK_SEMI);
-                                break;
-                        }
+                        declVar(type, STYPE_ARR, ident, n, local);
                 } else {
-                        _cg.SetGlo(type, STYPE_VAR, 0, ident);
-                        _cg.GenGlo(ident);
-                        if (_lex.Curr().Type() == TOK_SEMI) {
-                                _lex.Eat(TOK_SEMI);
-                                break;
-                        }
+                        declVar(type, STYPE_VAR, ident, 0, local);
+                }
+                if (_lex.Curr().Type() == TOK_SEMI) {
+                        _lex.Eat(TOK_SEMI);
+                        break;
                 }
                 if (_lex.Curr().Type() == TOK_COMMA) {
                         _lex.Eat(TOK_COMMA);
-                        ident = _lex.Curr().Lex();
+                        ident = _lex.Curr().Id();
                         _lex.Eat(TOK_IDENT);
                         continue;
                 }
@@ -255,56 +293,57 @@ void Parser::parseVarDecl(int type, const std::string& id)
         }
 }
 
-Ast *Parser::parseIf(void)
+AstRef Parser::parseIf(void)
 {
         _lex.Eat(TOK_IF);
         _lex.Eat(TOK_LPAREN);
         auto cond = parseExpr(0);
-        if (cond->Type() < AST_EQ || cond->Type() > AST_GE)
+        if (_ast[cond].Type() < AST_EQ || _ast[cond].Type() > AST_GE)
                 usage("parseIf: invalid comparison operator");
         _lex.Eat(TOK_RPAREN);
         auto truetree = ParseCompound();
-        Ast *falsetree {nullptr};
+        AstRef falsetree {NIL_AST};
         if (_lex.Curr().Type() == TOK_ELSE) {
                 _lex.Eat(TOK_ELSE);
                 falsetree = ParseCompound();
         }
-        return new Ast{AST_IF, TYPE_NONE, cond, truetree, falsetree, 0};
+        return _ast.NewIf(cond, truetree, falsetree);
 }
 
-Ast *Parser::parseWhile(void)
+AstRef Parser::parseWhile(void)
 {
         _lex.Eat(TOK_WHILE);
         _lex.Eat(TOK_LPAREN);
         auto cond = parseExpr(0);
-        if (cond->Type() < AST_EQ || cond->Type() > AST_GE)
-                usage("invalid comparison op: %s", cond->Name().c_str());
+        if (_ast[cond].Type() < AST_EQ || _ast[cond].Type() > AST_GE)
+                usage("invalid comparison op: %s", _ast[cond].Name().c_str());
         _lex.Eat(TOK_RPAREN);
         auto body = ParseCompound();
-        return new Ast{AST_WHILE, TYPE_NONE, cond, nullptr, body, 0};
+        return _ast.New(AST_WHILE, TYPE_NONE, cond, body, 0);
 }
 
-Ast *Parser::parseFor(void)
+AstRef Parser::parseFor(void)
 {
         _lex.Eat(TOK_FOR);
         _lex.Eat(TOK_LPAREN);
         auto pre = parseSingle();
         _lex.Eat(TOK_SEMI);
         auto cond = parseExpr(0);
-        if (cond->Type() < AST_EQ || cond->Type() > AST_GE)
-                usage("bad comparison operator: %s", cond->Name().c_str());
+        if (_ast[cond].Type() < AST_EQ || _ast[cond].Type() > AST_GE)
+                usage("bad comparison operator: %s",
+                                _ast[cond].Name().c_str());
         _lex.Eat(TOK_SEMI);
         auto post = parseSingle();
         _lex.Eat(TOK_RPAREN);
         auto body = ParseCompound();
-        auto tree = new Ast{AST_GLUE, TYPE_NONE, body, nullptr, post, 0};
-        tree = new Ast{AST_WHILE, TYPE_NONE, cond, nullptr, tree, 0};
-        return new Ast{AST_GLUE, TYPE_NONE, pre, nullptr, tree, 0};
+        auto tree = _ast.New(AST_GLUE, TYPE_NONE, body, post, 0);
+        tree = _ast.New(AST_WHILE, TYPE_NONE, cond, tree, 0);
+        return _ast.New(AST_GLUE, TYPE_NONE, pre, tree, 0);
 }
 
-Ast *Parser::parseSingle(void)
+AstRef Parser::parseSingle(void)
 {
-        std::string id;
+        Ident id;
         int type;
 
         switch (_lex.Curr().Type()) {
@@ -312,10 +351,10 @@ Ast *Parser::parseSingle(void)
         case TOK_INT:
         case TOK_LONG:
                 type = tok2prim(_lex, _lex.Curr().Type());
-                id = _lex.Curr().Lex();
+                id = _lex.Curr().Id();
                 _lex.Eat(TOK_IDENT);
-                parseVarDecl(type, id);
-                return nullptr;
+                parseVarDecl(type, id, 1);
+                return NIL_AST;
         case TOK_IF:
                 return parseIf();
         case TOK_WHILE:
@@ -327,36 +366,40 @@ Ast *Parser::parseSingle(void)
         default:
                 return parseExpr(0);
         }
-        return nullptr;
+        return NIL_AST;
 }
 
-Ast *Parser::ParseFuncDecl(int type, const std::string& id)
+AstRef Parser::ParseFuncDecl(int type, Ident id)
 {
-        func_id = id;
+        TraceSpan ts {"parse", interner.Name(id)};
+        _func = id;
 
         auto end = _cg.GetLabel();
-        _cg.SetGlo(type, STYPE_FUNC, end, id);
+        auto s = _cg.SetGlo(type, STYPE_FUNC, end, id);
 
         _lex.Eat(TOK_LPAREN);
         _lex.Eat(TOK_RPAREN);
+        _frame = 0;
+        _frameSize = 0;
         auto n = ParseCompound();
+        s->SetFrame((_frameSize + 7) & ~7);
 
         if (type != TYPE_VOID) {
-                if (n == nullptr)
+                if (n == NIL_AST)
                         usage("empty non-void function");
                 auto fin = n;
-                if (n->Type() == AST_GLUE)
-                        fin = n->Right();
-                if (fin == nullptr || fin->Type() != AST_RETURN)
+                if (_ast[n].Type() == AST_GLUE)
+                        fin = _ast[n].Right();
+                if (fin == NIL_AST || _ast[fin].Type() != AST_RETURN)
                         usage("no return for non-void function");
         }
 
-        return new Ast{AST_FUNC, type, n, id};
+        return _ast.New(AST_FUNC, type, n, NIL_AST, s->Ref());
 }
 
-Ast *Parser::parseRet(void)
+AstRef Parser::parseRet(void)
 {
-        auto s = _cg.GetGlo(func_id);
+        auto s = _cg.GetGlo(_func);
         if (s->Prim() == TOK_VOID)
                 usage("returning item from void function");
 
@@ -364,50 +407,52 @@ Ast *Parser::parseRet(void)
         _lex.Eat(TOK_LPAREN);
         auto tree = parseExpr(0);
 
-        tree = modify_type(_cg, tree, s->Prim(), 0);
-        if (tree == nullptr) {
+        tree = modify_type(_cg, _ast, tree, s->Prim(), 0);
+        if (tree == NIL_AST) {
                 puts("parseRet()");
                 usage("incompatible types");
         }
 
-        tree = new Ast{AST_RETURN, TYPE_NONE, tree, 0};
+        tree = _ast.New(AST_RETURN, TYPE_NONE, tree, NIL_AST, 0);
         _lex.Eat(TOK_RPAREN);
         return tree;
 }
 
-Ast *Parser::parseCall(const std::string& id)
+AstRef Parser::parseCall(Ident id)
 {
         auto s = _cg.GetGlo(id);
         _lex.Eat(TOK_LPAREN);
         auto tree = parseExpr(0);
-        tree = new Ast{AST_CALL, s->Prim(), tree, id};
+        tree = _ast.New(AST_CALL, s->Prim(), tree, NIL_AST, s->Ref());
         _lex.Eat(TOK_RPAREN);
         return tree;
 }
 
-Ast *Parser::parsePrefix(void)
+AstRef Parser::parsePrefix(void)
 {
-        Ast *n;
+        AstRef n;
 
         switch (_lex.Curr().Type()) {
         case TOK_AMPER:
                 _lex.Next();
                 n = parsePrefix();
 
-                if (n->Type() != AST_IDENT)
+                if (_ast[n].Type() != AST_IDENT)
                         usage("applying & to non-identifier");
 
-                n->SetType(AST_ADDR);
-                n->SetDtype(ptr_to(n->Dtype()));
+                _ast[n].SetType(AST_ADDR);
+                _ast[n].SetDtype(ptr_to(_ast[n].Dtype()));
                 break;
         case TOK_STAR:
                 _lex.Next();
                 n = parsePrefix();
 
-                if (n->Type() != AST_IDENT && n->Type() != AST_DEREF)
+                if (_ast[n].Type() != AST_IDENT &&
+                    _ast[n].Type() != AST_DEREF)
                         usage("* followed by ident or *");
 
-                n = new Ast{AST_DEREF, val_at(n->Dtype()), n, 0};
+                n = _ast.New(AST_DEREF, val_at(_ast[n].Dtype()),
+                                n, NIL_AST, 0);
                 break;
         default:
                 n = parsePrimary();
@@ -420,21 +465,34 @@ Ast *Parser::parsePrefix(void)
 void Parser::ParseDecls(void)
 {
         for (;;) {
+                FuncTimer ft;
+                PhaseTimer pt {PHASE_PARSE};
+
+                if (_cg.Caching())
+                        _lex.StartHash();
                 auto type = tok2prim(_lex, _lex.Curr().Type());
-                auto id = _lex.Curr().Lex();
+                auto id = _lex.Curr().Id();
                 _lex.Eat(TOK_IDENT);
                 if (_lex.Curr().Type() == TOK_LPAREN) {
+                        ft.Name(id);
                         auto n = ParseFuncDecl(type, id);
-                        _cg.GenAst(n, NIL_REG, 0);
-                        astfree(n);
+                        if (_cg.Opt() > 0)
+                                n = fold(_ast, n);
+                        _cg.GenFunc(_ast, n, _lex.TokHash());
+                        _ast.Reset();
                 } else {
-                        parseVarDecl(type, id);
+                        parseVarDecl(type, id, 0);
                 }
                 if (_lex.Curr().Type() == TOK_EOF)
                         break;
         }
 }
 
+const AstPool &Parser::Nodes(void) const
+{
+        return _ast;
+}
+
 static int inttype(int type)
 {
         switch (type) {
@@ -446,20 +504,26 @@ static int inttype(int type)
         return 0;
 }
 
-Ast *Parser::parseArrIdx(const std::string& id)
+AstRef Parser::parseArrIdx(Ident id)
 {
         auto s = _cg.GetGlo(id);
-        auto left = new Ast{AST_ADDR, s->Prim(), id};
+        auto left = _ast.New(AST_ADDR, s->Prim(), NIL_AST, NIL_AST,
+                        s->Ref());
 
         _lex.Eat(TOK_LBRACK);
         auto right = parseExpr(0);
 
         _lex.Eat(TOK_RBRACK);
-        if (!inttype(right->Dtype()))
+        if (!inttype(_ast[right].Dtype()))
                 usage("array index is not integer type");
 
-        right = modify_type(_cg, right, left->Dtype(), AST_ADD);
-        left = new Ast{AST_ADD, s->Prim(), left, nullptr, right, 0};
-        left = new Ast{AST_DEREF, val_at(left->Dtype()), left, 0};
+        // char elements need no scaling, so the index is kept as is
+        auto scaled = modify_type(_cg, _ast, right, _ast[left].Dtype(),
+                        AST_ADD);
+        if (scaled != NIL_AST)
+                right = scaled;
+        left = _ast.New(AST_ADD, s->Prim(), left, right, 0);
+        left = _ast.New(AST_DEREF, val_at(_ast[left].Dtype()),
+                        left, NIL_AST, 0);
         return left;
 }
@@ -4,53 +4,75 @@
 #include "Ast.h"
 #include "CodeGen.h"
 #include "Error.h"
+#include "Fold.h"
 #include "Lexer.h"
+#include "Timer.h"
+#include "Trace.h"
 #include "Type.h"
+#include <climits>
 #include <string>
 
-extern std::string func_id;
-
 // parser
 class Parser {
 private:
         CodeGen         &_cg;   // reference to code generator
         Lexer           &_lex;  // reference to lexical analyzer
+        AstPool         _ast;   // ast nodes of function being parsed
+        Ident           _func;  // function being parsed
+        int             _frame; // bytes of locals in scope
+        int             _frameSize;// most bytes of locals in scope at once
 
         // parse a variable declaration statement
-        void parseVarDecl(int type, const std::string& id);
+        //
+        // @type:       primitive type
+        // @id:         first name declared
+        // @local:      declared in a function?
+        void parseVarDecl(int type, Ident id, int local);
+
+        // declare a variable
+        //
+        // @prim:       primitive type, of elements for arrays
+        // @stype:      STYPE_VAR or STYPE_ARR
+        // @id:         name
+        // @n:          number of elements for arrays
+        // @local:      declared in a function?
+        void declVar(int prim, int stype, Ident id, int n, int local);
         // parse expression
-        Ast *parseExpr(int ptp);
+        AstRef parseExpr(int ptp);
         // parse primary
-        Ast *parsePrimary(void);
+        AstRef parsePrimary(void);
         // parse if statement
-        Ast *parseIf(void);
+        AstRef parseIf(void);
         // parse while statement
-        Ast *parseWhile(void);
+        AstRef parseWhile(void);
         // parse for statement
-        Ast *parseFor(void);
+        AstRef parseFor(void);
         // parse single statement
-        Ast *parseSingle(void);
+        AstRef parseSingle(void);
         // parse return statement
-        Ast *parseRet(void);
+        AstRef parseRet(void);
         // parse function call
-        Ast *parseCall(const std::string& id);
+        AstRef parseCall(Ident id);
         // parse prefix
-        Ast *parsePrefix(void);
+        AstRef parsePrefix(void);
         // parse array index
-        Ast *parseArrIdx(const std::string& id);
+        AstRef parseArrIdx(Ident id);
 public:
         // @lex:        reference to lexical analyzer
         // @cg:         reference to code generator
         Parser(Lexer &lex, CodeGen &cg);
 
         // parse a compound statement
-        Ast *ParseCompound(void);
+        AstRef ParseCompound(void);
 
         // parse a function declaration
-        Ast *ParseFuncDecl(int type, const std::string& id);
+        AstRef ParseFuncDecl(int type, Ident id);
 
         // parse global declarations
         void ParseDecls(void);
+
+        // get ast nodes
+        const AstPool &Nodes(void) const;
 };
 
 #endif
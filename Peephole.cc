@@ -0,0 +1,699 @@
+#include "Peephole.h"
+#include "RegAlloc.h"
+#include <algorithm>
+#include <cstring>
+
+PeepStats peepstats;
+
+// kinds of line
+enum {
+        INSN_OP,        // instruction
+        INSN_LABEL,     // label
+        INSN_OTHER,     // directive or blank line
+};
+
+// kinds of operand
+enum {
+        OPND_REG,       // register
+        OPND_IMM,       // immediate
+        OPND_MEM,       // memory, or jump target
+        OPND_OTHER,     // immediate address of a symbol
+};
+
+static const char *rule_names[NPEEP] = {
+        "imm",
+        "move",
+        "reload",
+        "self",
+        "dead",
+        "jump",
+        "setcc",
+        "test",
+        "xor",
+};
+
+static int isspace_(char c)
+{
+        return c == ' ' || c == '\t' || c == '\n';
+}
+
+// mnemonics the rules tell apart
+enum {
+        OP_OTHER,
+        OP_MOVQ,
+        OP_MOVL,
+        OP_MOVW,
+        OP_MOVB,
+        OP_MOVSLQ,
+        OP_MOVZBQ,
+        OP_MOVZBL,
+        OP_LEAQ,
+        OP_ADDQ,
+        OP_SUBQ,
+        OP_ANDQ,
+        OP_ORQ,
+        OP_XORQ,
+        OP_XORL,
+        OP_IMULQ,
+        OP_CMPQ,
+        OP_TESTQ,
+        OP_CALL,
+        OP_RET,
+        OP_CQO,
+        OP_IDIVQ,
+        OP_PUSHQ,
+        OP_POPQ,
+        OP_JMP,
+        OP_JCC,
+        OP_SETCC,
+        NOPS,
+};
+
+// classes of mnemonic
+enum {
+        OPC_MOVE = 1,   // reads source, writes destination
+        OPC_ALU = 2,    // reads both, writes destination and flags
+        OPC_CMP = 4,    // reads both, writes flags
+        OPC_IMM = 8,    // source may be an immediate of 32 bits
+};
+
+// mnemonic, in order of OP_*
+static const struct {
+        const char      *name;  // mnemonic, or null if matched by hand
+        int             cls;    // OPC_*
+        int             size;   // bytes read from source by a move
+} mnemonics[NOPS] = {
+        {nullptr,  0,                 0},
+        {"movq",   OPC_MOVE | OPC_IMM, 8},
+        {"movl",   OPC_MOVE,          4},
+        {"movw",   OPC_MOVE,          2},
+        {"movb",   OPC_MOVE,          1},
+        {"movslq", OPC_MOVE,          4},
+        {"movzbq", OPC_MOVE,          1},
+        {"movzbl", OPC_MOVE,          1},
+        {"leaq",   OPC_MOVE,          8},
+        {"addq",   OPC_ALU | OPC_IMM,  0},
+        {"subq",   OPC_ALU | OPC_IMM,  0},
+        {"andq",   OPC_ALU | OPC_IMM,  0},
+        {"orq",    OPC_ALU | OPC_IMM,  0},
+        {"xorq",   OPC_ALU | OPC_IMM,  0},
+        {"xorl",   OPC_ALU,           0},
+        {"imulq",  OPC_ALU,           0},
+        {"cmpq",   OPC_CMP | OPC_IMM,  0},
+        {"testq",  OPC_CMP | OPC_IMM,  0},
+        {"call",   0,                 0},
+        {"ret",    0,                 0},
+        {"cqo",    0,                 0},
+        {"idivq",  0,                 0},
+        {"pushq",  0,                 0},
+        {"popq",   0,                 0},
+        {nullptr,  0,                 0},
+        {nullptr,  0,                 0},
+        {nullptr,  0,                 0},
+};
+
+// get OP_* of mnemonic
+static int opcode(const char *p, size_t len)
+{
+        if (p[0] == 'j')
+                return len == 3 && memcmp(p, "jmp", 3) == 0 ? OP_JMP : OP_JCC;
+        if (len > 3 && memcmp(p, "set", 3) == 0)
+                return OP_SETCC;
+
+        for (int i = 0; i < NOPS; i++) {
+                auto name = mnemonics[i].name;
+                if (name && name[0] == p[0] &&
+                    strncmp(name, p, len) == 0 && name[len] == '\0')
+                        return i;
+        }
+        return OP_OTHER;
+}
+
+// get condition of the other outcome, or null
+static const char *negate(const std::string &cc)
+{
+        static const char *pairs[][2] = {
+                {"e", "ne"}, {"ne", "e"}, {"l", "ge"}, {"ge", "l"},
+                {"g", "le"}, {"le", "g"},
+        };
+
+        for (auto &p : pairs) {
+                if (cc == p[0])
+                        return p[1];
+        }
+        return nullptr;
+}
+
+// does condition cc hold for a compared with b, or -1 if unknown
+static int holds(const std::string &cc, long a, long b)
+{
+        if (cc == "e")
+                return a == b;
+        if (cc == "ne")
+                return a != b;
+        if (cc == "l")
+                return a < b;
+        if (cc == "le")
+                return a <= b;
+        if (cc == "g")
+                return a > b;
+        if (cc == "ge")
+                return a >= b;
+        return -1;
+}
+
+// registers an operand reads
+static uint32_t uses(int reg, uint32_t mem)
+{
+        return (reg >= 0 ? REG_BIT(reg) : 0) | mem;
+}
+
+Peephole::Peephole(void)
+        : _insns {},
+        _n {0},
+        _outs {},
+        _hits {}
+{}
+
+void Peephole::operand(Opnd &o, const char *p, size_t len)
+{
+        o.text.assign(p, len);
+        o.reg = -1;
+        o.size = 0;
+        o.mem = 0;
+        o.imm = 0;
+
+        if (len && p[0] == '%') {
+                o.kind = OPND_REG;
+                o.reg = RegAlloc::Find(p, len, o.size);
+                return;
+        }
+        if (len && p[0] == '$') {
+                char *end;
+                o.imm = strtol(o.text.c_str() + 1, &end, 10);
+                o.kind = *end == '\0' && len > 1 ? OPND_IMM : OPND_OTHER;
+                return;
+        }
+
+        // registers inside the parentheses address memory
+        o.kind = OPND_MEM;
+        for (size_t i = 0; i < len; i++) {
+                if (p[i] != '%')
+                        continue;
+
+                auto j = i + 1;
+                while (j < len && p[j] != ',' && p[j] != ')')
+                        j++;
+
+                int size;
+                auto r = RegAlloc::Find(p + i, j - i, size);
+                if (r >= 0)
+                        o.mem |= REG_BIT(r);
+                i = j;
+        }
+}
+
+void Peephole::analyze(Insn &in)
+{
+        in.rd = 0;
+        in.wr = 0;
+        in.frd = 0;
+        in.fwr = 0;
+        in.stop = 0;
+
+        if (in.kind != INSN_OP) {
+                in.stop = 1;
+                return;
+        }
+
+        auto &a = in.ops[0];
+        auto &b = in.ops[1];
+        auto ua = in.nops > 0 ? uses(a.reg, a.mem) : 0;
+        auto ub = in.nops > 1 ? uses(b.reg, b.mem) : 0;
+        auto wb = in.nops > 1 && b.reg >= 0 ? REG_BIT(b.reg) : 0;
+        auto cls = mnemonics[in.code].cls;
+
+        // an unknown instruction of two operands is taken as arithmetic
+        if (in.code == OP_OTHER && in.nops == 2)
+                cls = OPC_ALU;
+
+        if (in.nops == 2 && (cls & OPC_MOVE)) {
+                in.rd = ua | b.mem;
+                in.wr = wb;
+                // writing 1 or 2 bytes keeps the rest of the register
+                if (b.size && b.size < 4)
+                        in.rd |= wb;
+                return;
+        }
+        if (in.nops == 2 && (cls & OPC_ALU)) {
+                in.rd = ua | ub;
+                in.wr = wb;
+                in.fwr = 1;
+                return;
+        }
+        if (in.nops == 2 && (cls & OPC_CMP)) {
+                in.rd = ua | ub;
+                in.fwr = 1;
+                return;
+        }
+
+        switch (in.code) {
+        case OP_JMP:
+                in.stop = 1;
+                break;
+        case OP_JCC:
+                in.stop = 1;
+                in.frd = 1;
+                break;
+        case OP_SETCC:
+                // only the low byte is written
+                in.rd = ua;
+                in.wr = ua;
+                in.frd = 1;
+                break;
+        case OP_CALL:
+                in.rd = REG_BIT(GPR_RDI);
+                in.wr = REGS_CALLER;
+                in.fwr = 1;
+                break;
+        case OP_RET:
+                in.rd = REG_BIT(GPR_RAX) | REGS_CALLEE;
+                in.stop = 1;
+                break;
+        case OP_CQO:
+                in.rd = REG_BIT(GPR_RAX);
+                in.wr = REG_BIT(GPR_RDX);
+                break;
+        case OP_IDIVQ:
+                in.rd = ua | REG_BIT(GPR_RAX) | REG_BIT(GPR_RDX);
+                in.wr = REG_BIT(GPR_RAX) | REG_BIT(GPR_RDX);
+                in.fwr = 1;
+                break;
+        case OP_PUSHQ:
+                in.rd = ua;
+                break;
+        case OP_POPQ:
+                in.wr = ua;
+                break;
+        default:
+                // anything else may use anything
+                in.rd = ~0u;
+                in.wr = ~0u;
+                in.frd = 1;
+                in.fwr = 1;
+        }
+}
+
+void Peephole::parse(const Emit &code)
+{
+        auto data = code.Data();
+        auto end = data + code.Size();
+
+        _n = 0;
+        for (auto p = data; p < end; ) {
+                auto nl = (const char *)memchr(p, '\n', end - p);
+                auto eol = nl ? nl + 1 : end;
+
+                if (_n == _insns.size())
+                        _insns.emplace_back();
+
+                auto &in = _insns[_n++];
+                in.in = p - data;
+                in.len = eol - p;
+                in.code = OP_OTHER;
+                in.dead = 0;
+                in.nops = 0;
+
+                auto q = p;
+                auto e = eol;
+                while (q < e && isspace_(*q))
+                        q++;
+                while (e > q && isspace_(e[-1]))
+                        e--;
+                p = eol;
+
+                if (q == e || *q == '.') {
+                        in.kind = INSN_OTHER;
+                } else if (e[-1] == ':') {
+                        in.kind = INSN_LABEL;
+                        in.op.assign(q, e - 1 - q);
+                } else {
+                        auto m = q;
+                        while (m < e && !isspace_(*m))
+                                m++;
+                        in.kind = INSN_OP;
+                        in.op.assign(q, m - q);
+                        in.code = opcode(q, m - q);
+
+                        // operands are split at commas outside parentheses
+                        while (m < e && in.nops < 2) {
+                                while (m < e && isspace_(*m))
+                                        m++;
+
+                                auto s = m;
+                                int depth {0};
+                                for (; m < e && (depth || *m != ','); m++)
+                                        depth += (*m == '(') - (*m == ')');
+
+                                auto t = m;
+                                while (t > s && isspace_(t[-1]))
+                                        t--;
+                                operand(in.ops[in.nops++], s, t - s);
+                                if (m < e)
+                                        m++;
+                        }
+                        // more than two operands: leave the line alone
+                        if (m < e) {
+                                in.code = OP_OTHER;
+                                in.nops = 0;
+                        }
+                }
+                analyze(in);
+        }
+}
+
+size_t Peephole::next(size_t i) const
+{
+        for (i++; i < _n && _insns[i].dead; i++)
+                ;
+        return i;
+}
+
+size_t Peephole::back(size_t i, int lines) const
+{
+        while (lines > 0 && i > 0) {
+                if (!_insns[--i].dead)
+                        lines--;
+        }
+        return i;
+}
+
+int Peephole::dead(int r, size_t i) const
+{
+        for (auto j = next(i); j < _n; j = next(j)) {
+                auto &in = _insns[j];
+
+                if (in.rd & REG_BIT(r))
+                        return 0;
+                if (in.wr & REG_BIT(r))
+                        return 1;
+                if (in.stop)
+                        return r != GPR_RAX;
+        }
+        return r != GPR_RAX;
+}
+
+int Peephole::flagsDead(size_t i) const
+{
+        for (auto j = next(i); j < _n; j = next(j)) {
+                auto &in = _insns[j];
+
+                if (in.frd)
+                        return 0;
+                if (in.fwr || in.stop)
+                        return 1;
+        }
+        return 1;
+}
+
+void Peephole::set(size_t i, const std::string &op, const std::string &a,
+                const std::string &b)
+{
+        auto &in = _insns[i];
+
+        in.op = op;
+        in.code = opcode(op.data(), op.size());
+        in.nops = 0;
+        if (!a.empty())
+                operand(in.ops[in.nops++], a.data(), a.size());
+        if (!b.empty())
+                operand(in.ops[in.nops++], b.data(), b.size());
+        in.len = 0;
+        analyze(in);
+}
+
+void Peephole::drop(size_t i)
+{
+        _insns[i].dead = 1;
+}
+
+int Peephole::apply(size_t i)
+{
+        auto &a = _insns[i];
+
+        if (a.kind != INSN_OP || a.code == OP_OTHER)
+                return 0;
+
+        auto j = next(i);
+
+        // jump to the next instruction, maybe past other labels
+        if ((a.code == OP_JMP || a.code == OP_JCC) && a.nops == 1) {
+                for (auto k = j; k < _n && _insns[k].kind == INSN_LABEL;
+                     k = next(k)) {
+                        if (_insns[k].op == a.ops[0].text) {
+                                drop(i);
+                                _hits[PEEP_JUMP]++;
+                                return 1;
+                        }
+                }
+                return 0;
+        }
+
+        auto &x = a.ops[0];
+        auto &y = a.ops[1];
+        auto &am = mnemonics[a.code];
+
+        if (a.code == OP_MOVQ && a.nops == 2 && x.kind == OPND_REG &&
+            x.text == y.text) {
+                drop(i);
+                _hits[PEEP_SELF]++;
+                return 1;
+        }
+
+        if (a.nops == 2 && (am.cls & OPC_MOVE) && y.reg >= 0 &&
+            y.size >= 4 && dead(y.reg, i)) {
+                drop(i);
+                _hits[PEEP_DEAD]++;
+                return 1;
+        }
+
+        if (j < _n && _insns[j].kind == INSN_OP && a.nops == 2) {
+                auto &b = _insns[j];
+                auto &bx = b.ops[0];
+                auto &by = b.ops[1];
+                auto &bm = mnemonics[b.code];
+                auto r = y.reg;
+
+                // a register set by a and read by b, and dead after b
+                auto feeds = a.code == OP_MOVQ && r >= 0 && y.size == 8 &&
+                        b.nops == 2 && bx.reg == r &&
+                        !(uses(by.reg, by.mem) & REG_BIT(r)) &&
+                        dead(r, j);
+                // immediates other than in movq to a register are 32 bits
+                auto fits = x.kind != OPND_IMM || x.imm == (int32_t)x.imm;
+
+                if (feeds && x.kind == OPND_IMM) {
+                        auto v = x.imm;
+                        auto ok = 0;
+
+                        if (b.code == OP_MOVL) {
+                                v = (int32_t)v;
+                                ok = 1;
+                        } else if (b.code == OP_MOVB) {
+                                v = (int8_t)v;
+                                ok = 1;
+                        } else if (b.code == OP_IMULQ) {
+                                ok = fits && by.kind == OPND_REG;
+                        } else if (bm.cls & OPC_IMM) {
+                                ok = fits && bx.size == 8;
+                        }
+                        if (ok) {
+                                set(j, b.op, "$" + std::to_string(v),
+                                                by.text);
+                                drop(i);
+                                _hits[PEEP_IMM]++;
+                                return 1;
+                        }
+                }
+
+                if (feeds && b.code == OP_MOVQ && bx.size == 8 &&
+                    (fits || by.kind == OPND_REG) &&
+                    !(x.kind == OPND_MEM && by.kind == OPND_MEM)) {
+                        set(j, "movq", x.text, by.text);
+                        drop(i);
+                        _hits[PEEP_MOVE]++;
+                        return 1;
+                }
+
+                // load of what was just stored
+                auto stored = a.code == OP_MOVQ || a.code == OP_MOVL ||
+                        a.code == OP_MOVB ? am.size : 0;
+                auto loaded = b.code != OP_LEAQ && (bm.cls & OPC_MOVE) ?
+                        bm.size : 0;
+                if (stored && x.reg >= 0 && y.kind == OPND_MEM &&
+                    loaded && loaded <= stored && b.nops == 2 &&
+                    by.kind == OPND_REG && bx.text == y.text) {
+                        set(j, b.op, RegAlloc::Phys(x.reg, loaded),
+                                        by.text);
+                        _hits[PEEP_RELOAD]++;
+                        return 1;
+                }
+        }
+
+        // setcc, widen, compare with a constant and branch. the widened
+        // value is 0 or 1, so if the branch goes a different way for each
+        // it can test the condition itself
+        if (a.code == OP_SETCC && a.nops == 1 && x.reg >= 0) {
+                auto r = x.reg;
+                auto k = j < _n ? next(j) : _n;
+                auto l = k < _n ? next(k) : _n;
+
+                if (l < _n && _insns[j].code == OP_MOVZBQ &&
+                    _insns[j].ops[0].reg == r && _insns[j].ops[1].reg == r &&
+                    _insns[j].ops[1].size == 8 &&
+                    _insns[l].code == OP_JCC && _insns[l].nops == 1 &&
+                    dead(r, l)) {
+                        auto &c = _insns[k];
+                        auto &cy = c.ops[1];
+                        long v {0};
+                        int ok {0};
+
+                        if (c.code == OP_TESTQ && c.nops == 2 &&
+                            c.ops[0].reg == r && cy.reg == r) {
+                                ok = 1;
+                        } else if (c.code == OP_CMPQ && c.nops == 2 &&
+                                   c.ops[0].kind == OPND_IMM &&
+                                   cy.reg == r && cy.size == 8) {
+                                v = c.ops[0].imm;
+                                ok = 1;
+                        }
+
+                        auto jcc = _insns[l].op.substr(1);
+                        auto t0 = ok ? holds(jcc, 0, v) : -1;
+                        auto t1 = ok ? holds(jcc, 1, v) : -1;
+                        auto cc = a.op.substr(3);
+                        auto ncc = negate(cc);
+
+                        if (t0 >= 0 && t1 >= 0 && t0 != t1 && ncc) {
+                                set(l, "j" + (t1 ? cc : std::string{ncc}),
+                                                _insns[l].ops[0].text, "");
+                                drop(i);
+                                drop(j);
+                                drop(k);
+                                _hits[PEEP_SETCC]++;
+                                return 1;
+                        }
+                }
+        }
+
+        if (a.code == OP_CMPQ && a.nops == 2 && x.kind == OPND_IMM &&
+            x.imm == 0 && y.kind == OPND_REG) {
+                set(i, "testq", y.text, y.text);
+                _hits[PEEP_TEST]++;
+                return 1;
+        }
+
+        if (a.code == OP_MOVQ && a.nops == 2 && x.kind == OPND_IMM &&
+            x.imm == 0 && y.reg >= 0 && flagsDead(i)) {
+                auto r32 = RegAlloc::Phys(y.reg, 4);
+                set(i, "xorl", r32, r32);
+                _hits[PEEP_XOR]++;
+                return 1;
+        }
+
+        return 0;
+}
+
+void Peephole::Run(const Emit &code, Emit &out)
+{
+        auto data = code.Data();
+
+        std::fill(_hits, _hits + NPEEP, 0);
+        parse(code);
+
+        // a rewrite can let a rule match a few lines back
+        for (size_t i = 0; i < _n; ) {
+                if (!_insns[i].dead && apply(i))
+                        i = back(i, 3);
+                else
+                        i++;
+        }
+
+        _outs.clear();
+        for (size_t i = 0; i < _n; i++) {
+                auto &in = _insns[i];
+                Out o {in.in, out.Size(), -1};
+
+                if (in.dead) {
+                        o.out = SIZE_MAX;
+                } else if (in.len) {
+                        out.Put(data + in.in, in.len);
+                } else {
+                        o.lab = 0;
+                        out << "\t" << in.op.c_str();
+                        if (in.nops)
+                                out << "\t";
+                        // label numbers follow the L
+                        if (in.code == OP_JMP || in.code == OP_JCC)
+                                o.lab = out.Size() - o.out + 1;
+                        for (int k = 0; k < in.nops; k++) {
+                                if (k)
+                                        out << ", ";
+                                out << in.ops[k].text.c_str();
+                        }
+                        out << "\n";
+                }
+                _outs.push_back(o);
+        }
+
+        if (peepstats.On())
+                peepstats.Add(_hits);
+}
+
+size_t Peephole::Map(size_t off) const
+{
+        auto o = std::upper_bound(_outs.begin(), _outs.end(), off,
+                        [](size_t off, const Out &o) {
+                                return off < o.in;
+                        }) - 1;
+
+        if (o->out == SIZE_MAX)
+                return SIZE_MAX;
+        if (o->lab >= 0)
+                return o->out + o->lab;
+        return o->out + (off - o->in);
+}
+
+PeepStats::PeepStats(void)
+        : _hits {},
+        _on {0}
+{}
+
+void PeepStats::Enable(void)
+{
+        _on.store(1, std::memory_order_relaxed);
+}
+
+void PeepStats::Add(const uint64_t *hits)
+{
+        for (int i = 0; i < NPEEP; i++) {
+                if (hits[i])
+                        _hits[i].fetch_add(hits[i],
+                                        std::memory_order_relaxed);
+        }
+}
+
+void PeepStats::Print(FILE *fp) const
+{
+        uint64_t total {0};
+
+        fprintf(fp, "peephole:\n"
+                    "  %-8s %12s\n", "rule", "hits");
+        for (int i = 0; i < NPEEP; i++) {
+                auto n = _hits[i].load();
+                fprintf(fp, "  %-8s %12llu\n", rule_names[i],
+                                (unsigned long long)n);
+                total += n;
+        }
+        fprintf(fp, "  %-8s %12llu\n", "all", (unsigned long long)total);
+}
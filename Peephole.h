@@ -0,0 +1,166 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "Emit.h"
+#include "Error.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// peephole rules
+enum {
+        PEEP_IMM,       // movq $n, %r; op %r, x -> op $n, x
+        PEEP_MOVE,      // movq x, %r; movq %r, y -> movq x, y
+        PEEP_RELOAD,    // store to x; load of x -> move from register
+        PEEP_SELF,      // movq %r, %r dropped
+        PEEP_DEAD,      // move into a register never read dropped
+        PEEP_JUMP,      // jump to the next instruction dropped
+        PEEP_SETCC,     // setcc %r; movzbq; cmpq $n, %r; jcc -> jcc'
+        PEEP_TEST,      // cmpq $0, %r -> testq %r, %r
+        PEEP_XOR,       // movq $0, %r -> xorl %r, %r
+        NPEEP,
+};
+
+// peephole optimizer
+//
+// works on a function after register allocation, so it sees the real
+// registers. the function is split into instructions, and the rules
+// look at each instruction and the ones right after it, again after
+// every rewrite so one rule can set up the next. a register may only be
+// dropped when it is dead: read by nothing before it is written. values
+// never live from one statement to the next, and labels and jumps come
+// only between statements, so at those only %rax, holding the return
+// value, can still be live.
+//
+// lines no rule touches are copied as is, so a label number in one can
+// be followed to the output with Map()
+class Peephole {
+private:
+        // operand
+        struct Opnd {
+                std::string     text;   // as written
+                int             kind;   // OPND_*
+                int             reg;    // register if a register of
+                                        // ours, else -1
+                int             size;   // size of register
+                uint32_t        mem;    // registers addressing memory
+                long            imm;    // value of immediate
+        };
+
+        // line of code
+        struct Insn {
+                int             kind;   // INSN_*
+                std::string     op;     // mnemonic, or name of label
+                int             code;   // OP_* of mnemonic
+                Opnd            ops[2]; // operands
+                int             nops;   // number of operands
+                size_t          in;     // offset of line in code
+                size_t          len;    // length of line, 0 if rewritten
+                int             dead;   // dropped?
+                uint32_t        rd;     // registers read
+                uint32_t        wr;     // registers written
+                int             frd;    // reads flags?
+                int             fwr;    // writes flags?
+                int             stop;   // label, jump or directive?
+        };
+
+        // line as written out
+        struct Out {
+                size_t          in;     // offset of line in code
+                size_t          out;    // offset of line in output, or
+                                        // SIZE_MAX if dropped
+                int             lab;    // offset of label number in a
+                                        // rewritten line, or -1
+        };
+
+        std::vector<Insn>       _insns; // lines of function; kept from
+                                        // function to function so their
+                                        // strings keep their room
+        size_t                  _n;     // lines of function
+        std::vector<Out>        _outs;  // where each line went
+        uint64_t                _hits[NPEEP];// rules applied
+
+        // split code into lines
+        void parse(const Emit &code);
+
+        // find registers and flags an instruction reads and writes
+        void analyze(Insn &in);
+
+        // set operand from text
+        void operand(Opnd &o, const char *p, size_t len);
+
+        // get next line not dropped after i, or _n
+        size_t next(size_t i) const;
+
+        // get first line not dropped some lines before i
+        size_t back(size_t i, int lines) const;
+
+        // is register dead after line i?
+        int dead(int r, size_t i) const;
+
+        // are the flags dead after line i?
+        int flagsDead(size_t i) const;
+
+        // rewrite line i as an instruction
+        void set(size_t i, const std::string &op, const std::string &a,
+                        const std::string &b);
+
+        // drop line i
+        void drop(size_t i);
+
+        // apply the first rule that matches at line i, returns 1 if one
+        // did
+        int apply(size_t i);
+public:
+        // default constructor
+        Peephole(void);
+
+        Peephole(const Peephole &) = delete;
+        Peephole &operator=(const Peephole &) = delete;
+
+        // optimize function
+        //
+        // @code:       code of function
+        // @out:        output
+        void Run(const Emit &code, Emit &out);
+
+        // get offset in output of a label number in code, or SIZE_MAX if
+        // its line was dropped
+        //
+        // @off:        offset in code
+        size_t Map(size_t off) const;
+};
+
+// counts of peephole rules applied, for --peephole-stats
+class PeepStats {
+private:
+        std::atomic<uint64_t>   _hits[NPEEP];   // rules applied
+        std::atomic<int>        _on;            // counting?
+public:
+        PeepStats(void);
+
+        // start counting
+        void Enable(void);
+
+        // counting?
+        int On(void) const
+        {
+                return _on.load(std::memory_order_relaxed);
+        }
+
+        // add hits of a function
+        //
+        // @hits:       hits of each rule
+        void Add(const uint64_t *hits);
+
+        // print counts
+        //
+        // @fp:         file to print to
+        void Print(FILE *fp) const;
+};
+
+extern PeepStats peepstats;
+
+#endif
@@ -0,0 +1,110 @@
+#include "Pool.h"
+
+Pool::Pool(size_t n)
+        : _queues {},
+        _threads {},
+        _queued {0},
+        _running {0},
+        _next {0},
+        _stop {0}
+{
+        if (n == 0)
+                usage("thread pool needs at least one thread");
+
+        for (size_t i = 0; i < n; i++)
+                _queues.emplace_back(new Queue{});
+        for (size_t i = 0; i < n; i++)
+                _threads.emplace_back(&Pool::run, this, i);
+}
+
+void Pool::Submit(std::function<void(void)> task)
+{
+        std::unique_lock<std::mutex> guard {_lock};
+        auto &q = *_queues[_next++ % _queues.size()];
+
+        {
+                std::lock_guard<std::mutex> qguard {q.lock};
+                q.tasks.push_back(std::move(task));
+        }
+        _queued++;
+        guard.unlock();
+        _work.notify_one();
+}
+
+int Pool::take(size_t self, std::function<void(void)> &task)
+{
+        auto n = _queues.size();
+
+        for (size_t i = 0; i < n; i++) {
+                auto &q = *_queues[(self + i) % n];
+                std::lock_guard<std::mutex> guard {q.lock};
+
+                if (q.tasks.empty())
+                        continue;
+
+                if (i == 0) {
+                        task = std::move(q.tasks.back());
+                        q.tasks.pop_back();
+                } else {
+                        task = std::move(q.tasks.front());
+                        q.tasks.pop_front();
+                }
+                return 1;
+        }
+
+        return 0;
+}
+
+void Pool::run(size_t self)
+{
+        std::function<void(void)> task;
+
+        for (;;) {
+                {
+                        std::unique_lock<std::mutex> guard {_lock};
+                        while (_queued == 0 && !_stop)
+                                _work.wait(guard);
+                        if (_queued == 0)
+                                return;
+                        _queued--;
+                        _running++;
+                }
+
+                // a task was counted for us, so some queue holds it
+                while (!take(self, task))
+                        std::this_thread::yield();
+
+                task();
+                task = nullptr;
+
+                std::lock_guard<std::mutex> guard {_lock};
+                _running--;
+                if (_queued == 0 && _running == 0)
+                        _idle.notify_all();
+        }
+}
+
+void Pool::Wait(void)
+{
+        std::unique_lock<std::mutex> guard {_lock};
+
+        while (_queued != 0 || _running != 0)
+                _idle.wait(guard);
+}
+
+size_t Pool::Size(void) const
+{
+        return _threads.size();
+}
+
+Pool::~Pool()
+{
+        {
+                std::lock_guard<std::mutex> guard {_lock};
+                _stop = 1;
+        }
+        _work.notify_all();
+
+        for (auto &t : _threads)
+                t.join();
+}
@@ -0,0 +1,61 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "Error.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work-stealing thread pool
+//
+// every worker has its own queue. tasks are dealt out to the queues in
+// turn; a worker runs its own tasks newest first and, when it runs out,
+// steals the oldest task from another worker's queue
+class Pool {
+private:
+        // queue of one worker
+        struct Queue {
+                std::mutex                              lock;
+                std::deque<std::function<void(void)>>   tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>>     _queues;  // worker queues
+        std::vector<std::thread>                _threads; // workers
+        std::mutex                              _lock;    // guards below
+        std::condition_variable                 _work;    // task queued
+        std::condition_variable                 _idle;    // task finished
+        size_t                                  _queued;  // tasks queued
+        size_t                                  _running; // tasks running
+        size_t                                  _next;    // next queue to
+                                                          // deal to
+        int                                     _stop;    // shutting down?
+
+        // worker loop
+        void run(size_t self);
+
+        // take a task, from own queue first, else steal one
+        int take(size_t self, std::function<void(void)> &task);
+public:
+        // @n:          number of worker threads
+        Pool(size_t n);
+
+        Pool(const Pool &) = delete;
+        Pool &operator=(const Pool &) = delete;
+
+        // queue a task
+        void Submit(std::function<void(void)> task);
+
+        // wait until every queued task has finished
+        void Wait(void);
+
+        // get number of worker threads
+        size_t Size(void) const;
+
+        ~Pool();
+};
+
+#endif
@@ -0,0 +1,549 @@
+#include "RegAlloc.h"
+#include <algorithm>
+#include <cstring>
+
+// starts a placeholder: then size letter and virtual register number
+#define MARK '\x01'
+
+// registers spilled values are loaded into
+static const int scratch[3] = {GPR_R10, GPR_R11, GPR_RSI};
+
+static constexpr int NSCRATCH = sizeof(scratch) / sizeof(*scratch);
+
+// registers in the order they are handed out: caller saved ones cost
+// nothing to use, and the ones with fixed jobs come last of those
+static const int prefer[NREGS] = {
+        GPR_R8, GPR_R9, GPR_R10, GPR_R11, GPR_RCX, GPR_RSI, GPR_RDI,
+        GPR_RDX, GPR_RAX, GPR_RBX, GPR_R12, GPR_R13, GPR_R14, GPR_R15,
+};
+
+// callee saved registers in the order they are saved
+static const int callee[] = {
+        GPR_RBX, GPR_R12, GPR_R13, GPR_R14, GPR_R15,
+};
+
+static int sizeidx(int size)
+{
+        switch (size) {
+        case 1: return 0;
+        case 2: return 1;
+        case 4: return 2;
+        case 8: return 3;
+        default:
+                usage("invalid register size: %d", size);
+                exit(EXIT_FAILURE);
+        }
+}
+
+// get first register of preference order in set
+static int pick(uint32_t regs)
+{
+        for (auto r : prefer) {
+                if (regs & REG_BIT(r))
+                        return r;
+        }
+        return -1;
+}
+
+// parse placeholder at p, returns virtual register and sets size index
+// and end of placeholder
+static size_t parse(const char *p, int &size, const char *&end)
+{
+        static const char sizes[] = "bwlq";
+        size_t r {0};
+
+        size = strchr(sizes, p[1]) - sizes;
+        for (p += 2; *p >= '0' && *p <= '9'; p++)
+                r = r * 10 + (*p - '0');
+        end = p;
+        return r;
+}
+
+RegAlloc::RegAlloc(void)
+        : _vregs {},
+        _n {0},
+        _clobs {},
+        _segs {},
+        _order {},
+        _saved {0},
+        _nslots {0},
+        _locals {0}
+{}
+
+void RegAlloc::Start(void)
+{
+        _n = 0;
+        _clobs.clear();
+        _saved = 0;
+        _nslots = 0;
+        _locals = 0;
+}
+
+void RegAlloc::Reserve(int size)
+{
+        if (size < 0 || size % 8)
+                usage("invalid size of locals: %d", size);
+        _locals = size;
+}
+
+size_t RegAlloc::Get(void)
+{
+        if (_n == _vregs.size()) {
+                static const char sizes[] = "bwlq";
+                Vreg v {};
+
+                for (int i = 0; i < 4; i++) {
+                        snprintf(v.names[i], sizeof(v.names[i]), "%c%c%zu",
+                                        MARK, sizes[i], _n);
+                }
+                _vregs.push_back(v);
+        }
+
+        auto &v = _vregs[_n];
+        v.uses = 0;
+        v.avoid = 0;
+        v.reg = -1;
+        v.slot = -1;
+        return _n++;
+}
+
+const char *RegAlloc::Name(size_t r)
+{
+        return Name(r, 8);
+}
+
+const char *RegAlloc::Name(size_t r, int size)
+{
+        if (r >= _n)
+                usage("invalid register: %zu", r);
+
+        return _vregs[r].names[sizeidx(size)];
+}
+
+void RegAlloc::Clobber(size_t off, uint32_t regs)
+{
+        _clobs.push_back(Clob{off, regs});
+}
+
+void RegAlloc::scan(const Emit &code)
+{
+        auto data = code.Data();
+        auto end = data + code.Size();
+        int size;
+
+        // values go in order of first being named, which is the order
+        // of their live ranges
+        _order.clear();
+        for (auto p = data; (p = (const char *)memchr(p, MARK, end - p)); ) {
+                uint32_t off = p - data;
+                auto r = parse(p, size, p);
+                auto &v = _vregs[r];
+
+                if (v.uses++ == 0) {
+                        v.start = off;
+                        _order.push_back(r);
+                }
+                v.end = off;
+        }
+
+        // clobbers are in order and values short lived, so only the few
+        // after each start are looked at
+        for (auto i : _order) {
+                auto &v = _vregs[i];
+                auto c = std::lower_bound(_clobs.begin(), _clobs.end(),
+                                v.start, [](const Clob &c, size_t off) {
+                                        return c.off < off;
+                                });
+
+                for (; c != _clobs.end() && c->off < v.end; c++)
+                        v.avoid |= c->regs;
+        }
+}
+
+int RegAlloc::linear(uint32_t regs)
+{
+        std::vector<uint32_t> active;
+        int nspill {0};
+
+        for (auto i : _order) {
+                auto &v = _vregs[i];
+                uint32_t busy {0};
+                size_t k {0};
+
+                // values last named before ours is first are done with
+                // their registers
+                for (auto j : active) {
+                        if (_vregs[j].end >= v.start) {
+                                active[k++] = j;
+                                busy |= REG_BIT(_vregs[j].reg);
+                        }
+                }
+                active.resize(k);
+
+                auto free = regs & ~busy & ~v.avoid;
+                if (free) {
+                        v.reg = pick(free);
+                        active.push_back(i);
+                        continue;
+                }
+
+                // spill whichever of us and the live values we could take
+                // the register of is live the longest
+                nspill++;
+                auto victim = i;
+                for (auto j : active) {
+                        auto &w = _vregs[j];
+                        if ((REG_BIT(w.reg) & regs & ~v.avoid) &&
+                            w.end > _vregs[victim].end)
+                                victim = j;
+                }
+                if (victim == i) {
+                        v.reg = -1;
+                        continue;
+                }
+                v.reg = _vregs[victim].reg;
+                _vregs[victim].reg = -1;
+                std::replace(active.begin(), active.end(), victim, i);
+        }
+
+        return nspill;
+}
+
+int RegAlloc::color(uint32_t regs)
+{
+        auto n = _order.size();
+        std::vector<std::vector<uint32_t>> adj(n);
+        std::vector<uint32_t> active;
+        std::vector<uint32_t> deg(n);
+        std::vector<uint32_t> k(n);
+        std::vector<char> gone(n);
+        std::vector<uint32_t> low;
+        std::vector<uint32_t> stack;
+        int nspill {0};
+
+        // values interfere if their live ranges overlap
+        for (uint32_t i = 0; i < n; i++) {
+                auto &v = _vregs[_order[i]];
+                size_t m {0};
+
+                for (auto j : active) {
+                        if (_vregs[_order[j]].end < v.start)
+                                continue;
+                        active[m++] = j;
+                        adj[i].push_back(j);
+                        adj[j].push_back(i);
+                }
+                active.resize(m);
+                active.push_back(i);
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+                deg[i] = adj[i].size();
+                k[i] = __builtin_popcount(regs & ~_vregs[_order[i]].avoid);
+                if (deg[i] < k[i])
+                        low.push_back(i);
+        }
+
+        // simplify: take out values that will surely get a register, and
+        // when there are none, the one cheapest to spill, in hope
+        while (stack.size() < n) {
+                uint32_t i;
+
+                if (!low.empty()) {
+                        i = low.back();
+                        low.pop_back();
+                        if (gone[i])
+                                continue;
+                } else {
+                        double best {0};
+                        i = n;
+                        for (uint32_t j = 0; j < n; j++) {
+                                if (gone[j])
+                                        continue;
+                                auto cost = (double)_vregs[_order[j]].uses /
+                                        (deg[j] + 1);
+                                if (i == n || cost < best) {
+                                        i = j;
+                                        best = cost;
+                                }
+                        }
+                }
+
+                gone[i] = 1;
+                stack.push_back(i);
+                for (auto j : adj[i]) {
+                        if (!gone[j] && deg[j]-- == k[j])
+                                low.push_back(j);
+                }
+        }
+
+        // select: color in reverse, spilling what finds no register
+        std::vector<char> done(n);
+        while (!stack.empty()) {
+                auto i = stack.back();
+                auto &v = _vregs[_order[i]];
+                uint32_t used {0};
+
+                stack.pop_back();
+                for (auto j : adj[i]) {
+                        auto r = _vregs[_order[j]].reg;
+                        if (done[j] && r >= 0)
+                                used |= REG_BIT(r);
+                }
+
+                auto free = regs & ~used & ~v.avoid;
+                v.reg = free ? pick(free) : -1;
+                if (v.reg < 0)
+                        nspill++;
+                done[i] = 1;
+        }
+
+        return nspill;
+}
+
+void RegAlloc::slots(void)
+{
+        std::vector<uint32_t> last;     // end of each slot's value
+
+        for (auto i : _order) {
+                auto &v = _vregs[i];
+                if (v.reg >= 0) {
+                        _saved |= REG_BIT(v.reg) & REGS_CALLEE;
+                        continue;
+                }
+
+                v.slot = -1;
+                for (size_t s = 0; s < last.size(); s++) {
+                        if (last[s] < v.start) {
+                                v.slot = s;
+                                break;
+                        }
+                }
+                if (v.slot < 0) {
+                        v.slot = last.size();
+                        last.push_back(0);
+                }
+                last[v.slot] = v.end;
+        }
+        _nslots = last.size();
+}
+
+int RegAlloc::slotOff(int slot) const
+{
+        return -_locals - 8 * (__builtin_popcount(_saved) + slot + 1);
+}
+
+void RegAlloc::Alloc(const Emit &code, int algo)
+{
+        uint32_t regs {(1u << NREGS) - 1};
+
+        scan(code);
+
+        auto run = [this, algo](uint32_t regs) {
+                return algo == RA_COLOR ? color(regs) : linear(regs);
+        };
+        if (run(regs) > 0) {
+                // spilled values need somewhere to be loaded into
+                for (auto r : scratch)
+                        regs &= ~REG_BIT(r);
+                run(regs);
+        }
+        slots();
+}
+
+void RegAlloc::Enter(Emit &out) const
+{
+        int nsaved = __builtin_popcount(_saved);
+        int size = (_locals + 8 * (nsaved + _nslots) + 15) & ~15;
+        int off {-_locals};
+
+        // keep %rsp 16 byte aligned for calls
+        if (size)
+                out << "\tsubq\t$" << size << ", %rsp\n";
+        for (auto r : callee) {
+                if (_saved & REG_BIT(r)) {
+                        off -= 8;
+                        out << "\tmovq\t" << Phys(r, 8) << ", " << off
+                                << "(%rbp)\n";
+                }
+        }
+}
+
+void RegAlloc::Leave(Emit &out) const
+{
+        int off {-_locals};
+
+        for (auto r : callee) {
+                if (_saved & REG_BIT(r)) {
+                        off -= 8;
+                        out << "\tmovq\t" << off << "(%rbp), " << Phys(r, 8)
+                                << "\n";
+                }
+        }
+        if (_locals || _saved || _nslots)
+                out << "\tmovq\t%rbp, %rsp\n";
+}
+
+void RegAlloc::line(const char *data, const char *p, const char *eol,
+                Emit &out)
+{
+        size_t spilled[NSCRATCH];
+        int nspilled {0};
+        const char *q;
+        int size;
+
+        // spilled values named on line
+        for (q = p; _nslots && (q = (const char *)memchr(q, MARK, eol - q)); ) {
+                auto r = parse(q, size, q);
+                if (_vregs[r].reg >= 0 ||
+                    std::find(spilled, spilled + nspilled, r) !=
+                    spilled + nspilled)
+                        continue;
+                if (nspilled == NSCRATCH)
+                        usage("too many spilled values on a line");
+                spilled[nspilled++] = r;
+        }
+
+        for (int i = 0; i < nspilled; i++) {
+                auto &v = _vregs[spilled[i]];
+                if (v.start < (size_t)(p - data))
+                        out << "\tmovq\t" << slotOff(v.slot) << "(%rbp), "
+                                << Phys(scratch[i], 8) << "\n";
+        }
+
+        while ((q = (const char *)memchr(p, MARK, eol - p))) {
+                out.Put(p, q - p);
+
+                auto r = parse(q, size, p);
+                auto reg = _vregs[r].reg;
+                if (reg < 0)
+                        reg = scratch[std::find(spilled, spilled + nspilled,
+                                        r) - spilled];
+                out << Phys(reg, 1 << size);
+        }
+        out.Put(p, eol - p);
+
+        for (int i = 0; i < nspilled; i++) {
+                auto &v = _vregs[spilled[i]];
+                if (v.end >= (size_t)(eol - data))
+                        out << "\tmovq\t" << Phys(scratch[i], 8) << ", "
+                                << slotOff(v.slot) << "(%rbp)\n";
+        }
+}
+
+void RegAlloc::Rewrite(const Emit &code, Emit &out)
+{
+        auto data = code.Data();
+        auto end = data + code.Size();
+        auto p = data;
+        const char *q;
+
+        // text between lines naming virtual registers is copied as is
+        _segs.clear();
+        while ((q = (const char *)memchr(p, MARK, end - p))) {
+                auto bol = (const char *)memrchr(p, '\n', q - p);
+                auto nl = (const char *)memchr(q, '\n', end - q);
+
+                bol = bol ? bol + 1 : p;
+                _segs.push_back(Seg{(size_t)(p - data), out.Size()});
+                out.Put(p, bol - p);
+
+                p = nl ? nl + 1 : end;
+                line(data, bol, p, out);
+        }
+        _segs.push_back(Seg{(size_t)(p - data), out.Size()});
+        out.Put(p, end - p);
+}
+
+size_t RegAlloc::Map(size_t off) const
+{
+        auto s = std::upper_bound(_segs.begin(), _segs.end(), off,
+                        [](size_t off, const Seg &s) {
+                                return off < s.in;
+                        }) - 1;
+
+        return s->out + (off - s->in);
+}
+
+// names of registers of each size
+static const char *names[NREGS][4] = {
+        {"%al",   "%ax",   "%eax",  "%rax"},
+        {"%bl",   "%bx",   "%ebx",  "%rbx"},
+        {"%cl",   "%cx",   "%ecx",  "%rcx"},
+        {"%dl",   "%dx",   "%edx",  "%rdx"},
+        {"%sil",  "%si",   "%esi",  "%rsi"},
+        {"%dil",  "%di",   "%edi",  "%rdi"},
+        {"%r8b",  "%r8w",  "%r8d",  "%r8"},
+        {"%r9b",  "%r9w",  "%r9d",  "%r9"},
+        {"%r10b", "%r10w", "%r10d", "%r10"},
+        {"%r11b", "%r11w", "%r11d", "%r11"},
+        {"%r12b", "%r12w", "%r12d", "%r12"},
+        {"%r13b", "%r13w", "%r13d", "%r13"},
+        {"%r14b", "%r14w", "%r14d", "%r14"},
+        {"%r15b", "%r15w", "%r15d", "%r15"},
+};
+
+const char *RegAlloc::Phys(int r, int size)
+{
+        if (r < 0 || r >= NREGS)
+                usage("invalid register: %d", r);
+
+        return names[r][sizeidx(size)];
+}
+
+int RegAlloc::Find(const char *name, size_t len, int &size)
+{
+        // the names follow a few patterns, so they are taken apart by hand
+        // rather than looked up in names: this is called for every operand
+        // the peephole optimizer reads
+        static const char words[][3] = {"ax", "bx", "cx", "dx", "si", "di"};
+        auto p = name + 1;
+        auto n = len - 1;
+
+        if (len < 3 || name[0] != '%')
+                return -1;
+
+        if (p[0] == 'r' && p[1] >= '0' && p[1] <= '9') {
+                int r = p[1] - '0';
+                size_t i = 2;
+
+                if (i < n && p[i] >= '0' && p[i] <= '9')
+                        r = r * 10 + p[i++] - '0';
+                if (r < 8 || r > 15 || n - i > 1)
+                        return -1;
+                size = i == n ? 8 : p[i] == 'd' ? 4 : p[i] == 'w' ? 2 :
+                        p[i] == 'b' ? 1 : 0;
+                return size ? GPR_R8 + r - 8 : -1;
+        }
+
+        // the rest are named after their word register: %rax, %eax, %ax,
+        // %al, and %sil for %si
+        char w0, w1;
+        int sz;
+        if (n == 3 && (p[0] == 'r' || p[0] == 'e')) {
+                w0 = p[1];
+                w1 = p[2];
+                sz = p[0] == 'r' ? 8 : 4;
+        } else if (n == 2) {
+                w0 = p[0];
+                w1 = p[1] == 'l' ? 'x' : p[1];
+                sz = p[1] == 'l' ? 1 : 2;
+        } else if (n == 3 && p[2] == 'l') {
+                w0 = p[0];
+                w1 = p[1];
+                sz = 1;
+        } else {
+                return -1;
+        }
+
+        for (int r = GPR_RAX; r <= GPR_RDI; r++) {
+                if (words[r][0] != w0 || words[r][1] != w1)
+                        continue;
+                // only %si and %di have a low byte named with an l
+                if (n == 3 && sz == 1 && r < GPR_RSI)
+                        return -1;
+                size = sz;
+                return r;
+        }
+        return -1;
+}
@@ -0,0 +1,217 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "Emit.h"
+#include "Error.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// general purpose registers, all but %rsp and %rbp. not REG_*, which
+// <signal.h> takes for the registers of a ucontext
+enum {
+        GPR_RAX,
+        GPR_RBX,
+        GPR_RCX,
+        GPR_RDX,
+        GPR_RSI,
+        GPR_RDI,
+        GPR_R8,
+        GPR_R9,
+        GPR_R10,
+        GPR_R11,
+        GPR_R12,
+        GPR_R13,
+        GPR_R14,
+        GPR_R15,
+        NREGS,
+};
+
+// register set of one register
+#define REG_BIT(r)      (1u << (r))
+
+// registers a call may change
+#define REGS_CALLER     (REG_BIT(GPR_RAX) | REG_BIT(GPR_RCX) | \
+                         REG_BIT(GPR_RDX) | REG_BIT(GPR_RSI) | \
+                         REG_BIT(GPR_RDI) | REG_BIT(GPR_R8) | \
+                         REG_BIT(GPR_R9) | REG_BIT(GPR_R10) | \
+                         REG_BIT(GPR_R11))
+
+// registers a function must give back as it found them
+#define REGS_CALLEE     (REG_BIT(GPR_RBX) | REG_BIT(GPR_R12) | \
+                         REG_BIT(GPR_R13) | REG_BIT(GPR_R14) | \
+                         REG_BIT(GPR_R15))
+
+// register allocation algorithms
+enum {
+        RA_LINEAR,      // linear scan
+        RA_COLOR,       // graph coloring
+};
+
+// register allocator
+//
+// the code generator writes a function with virtual registers: Name()
+// gives a placeholder that is written into the code like a register
+// name. once the function is done, Alloc() finds where in the code each
+// virtual register is first and last named and gives each one a register
+// or, if there are too few, a stack slot. Rewrite() then writes the code
+// out with the placeholders replaced.
+//
+// values never live from one statement to the next, so a value is live
+// exactly from where it is first named to where it is last named, and
+// live ranges are byte offsets into the code: a value last read on the
+// line another is first written on may share its register, as operands
+// are read before results are written. instructions that use fixed
+// registers (division, calls, returns) report them with Clobber(), and
+// no value live across such a line is put in one of them; that is how
+// values living across calls end up in callee saved registers. a line
+// may name at most three spilled values: they are loaded into %r10,
+// %r11 and %rsi, which are kept out of allocation once anything has to
+// spill.
+//
+// from %rbp down, the frame holds the local variables given to
+// Reserve(), the callee saved registers used and the spill slots
+class RegAlloc {
+private:
+        // virtual register
+        struct Vreg {
+                char            names[4][16];   // placeholder of each size
+                uint32_t        start;  // offset first named at
+                uint32_t        end;    // offset last named at
+                uint32_t        uses;   // number of times named
+                uint32_t        avoid;  // registers clobbered while live
+                int             reg;    // register, or -1 if spilled
+                int             slot;   // stack slot if spilled
+        };
+
+        // line clobbering registers
+        struct Clob {
+                size_t          off;    // offset of line in code
+                uint32_t        regs;   // registers clobbered
+        };
+
+        // text of code copied to output unchanged
+        struct Seg {
+                size_t          in;     // offset in code
+                size_t          out;    // offset in output
+        };
+
+        std::deque<Vreg>        _vregs; // virtual registers; kept from
+                                        // function to function so their
+                                        // placeholders are made once
+        size_t                  _n;     // virtual registers of function
+        std::vector<Clob>       _clobs; // lines clobbering registers, in
+                                        // order
+        std::vector<Seg>        _segs;  // text copied as is by Rewrite()
+        std::vector<uint32_t>   _order; // virtual registers by start
+        uint32_t                _saved; // callee saved registers used
+        int                     _nslots;// spill slots used
+        int                     _locals;// bytes of local variables at top
+                                        // of frame
+
+        // find live ranges in code
+        void scan(const Emit &code);
+
+        // give registers by linear scan, returns number spilled
+        //
+        // @regs:       registers to give out
+        int linear(uint32_t regs);
+
+        // give registers by graph coloring, returns number spilled
+        //
+        // @regs:       registers to give out
+        int color(uint32_t regs);
+
+        // give spilled values stack slots
+        void slots(void);
+
+        // get frame offset of spill slot
+        int slotOff(int slot) const;
+
+        // rewrite line naming virtual registers, loading and storing
+        // spilled ones around it
+        //
+        // @data:       code
+        // @p:          start of line
+        // @eol:        end of line
+        // @out:        output
+        void line(const char *data, const char *p, const char *eol,
+                        Emit &out);
+public:
+        // default constructor
+        RegAlloc(void);
+
+        RegAlloc(const RegAlloc &) = delete;
+        RegAlloc &operator=(const RegAlloc &) = delete;
+
+        // start a new function
+        void Start(void);
+
+        // reserve room for local variables at the top of the frame, right
+        // below %rbp; saved registers and spill slots go below them
+        //
+        // @size:       bytes of local variables, a multiple of 8
+        void Reserve(int size);
+
+        // get a new virtual register
+        size_t Get(void);
+
+        // get placeholder of virtual register
+        const char *Name(size_t r);
+
+        // get placeholder of low size bytes of virtual register
+        //
+        // @r:          virtual register
+        // @size:       1, 2, 4 or 8
+        const char *Name(size_t r, int size);
+
+        // note that the line starting at off clobbers registers
+        //
+        // @off:        offset of line in code
+        // @regs:       registers clobbered
+        void Clobber(size_t off, uint32_t regs);
+
+        // allocate registers of function
+        //
+        // @code:       code of function, with placeholders
+        // @algo:       RA_LINEAR or RA_COLOR
+        void Alloc(const Emit &code, int algo);
+
+        // set up frame and save callee saved registers used
+        //
+        // @out:        output
+        void Enter(Emit &out) const;
+
+        // restore callee saved registers and tear down frame
+        //
+        // @out:        output
+        void Leave(Emit &out) const;
+
+        // write code out with registers in place of placeholders
+        //
+        // @code:       code of function, with placeholders
+        // @out:        output
+        void Rewrite(const Emit &code, Emit &out);
+
+        // get offset in rewritten code of text in a line of code that
+        // names no virtual registers
+        //
+        // @off:        offset in code
+        size_t Map(size_t off) const;
+
+        // get name of register
+        //
+        // @r:          register
+        // @size:       1, 2, 4 or 8
+        static const char *Phys(int r, int size);
+
+        // get register of name, the inverse of Phys()
+        //
+        // @name:       register name, with the %
+        // @len:        length of name
+        // @size:       set to size of register if found
+        // returns register, or -1 if name is not one of ours
+        static int Find(const char *name, size_t len, int &size);
+};
+
+#endif
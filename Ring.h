@@ -0,0 +1,89 @@
+#ifndef RING_H
+#define RING_H
+
+#include "Error.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// bounded single-producer/single-consumer ring of slots
+//
+// slots are filled and drained in place: the producer gets a free slot
+// with Back(), writes it, then publishes it with Push(); the consumer
+// gets the oldest slot with Front() and gives it back with Pop(). Back()
+// and Front() wait while the ring is full or empty, which bounds how far
+// the producer can run ahead
+template <typename T>
+class Ring {
+private:
+        std::vector<T>          _slots; // slots
+        size_t                  _mask;  // number of slots - 1
+        char                    _pad0[64];
+        std::atomic<size_t>     _head;  // next slot to pop
+        char                    _pad1[64];
+        std::atomic<size_t>     _tail;  // next slot to push
+        char                    _pad2[64];
+        std::atomic<int>        _stop;  // stop waiting?
+public:
+        // @n:          number of slots (power of 2)
+        Ring(size_t n)
+                : _slots(n),
+                _mask {n - 1},
+                _head {0},
+                _tail {0},
+                _stop {0}
+        {
+                if (n == 0 || (n & (n - 1)) != 0)
+                        usage("ring size not a power of 2: %zu", n);
+        }
+
+        // get slot to fill, nullptr if stopped
+        T *Back(void)
+        {
+                auto t = _tail.load(std::memory_order_relaxed);
+
+                while (t - _head.load(std::memory_order_acquire) > _mask) {
+                        if (_stop.load(std::memory_order_relaxed))
+                                return nullptr;
+                        std::this_thread::yield();
+                }
+
+                return &_slots[t & _mask];
+        }
+
+        // publish slot returned by Back()
+        void Push(void)
+        {
+                _tail.store(_tail.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_release);
+        }
+
+        // get oldest filled slot, nullptr if stopped
+        T *Front(void)
+        {
+                auto h = _head.load(std::memory_order_relaxed);
+
+                while (_tail.load(std::memory_order_acquire) == h) {
+                        if (_stop.load(std::memory_order_relaxed))
+                                return nullptr;
+                        std::this_thread::yield();
+                }
+
+                return &_slots[h & _mask];
+        }
+
+        // release slot returned by Front()
+        void Pop(void)
+        {
+                _head.store(_head.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_release);
+        }
+
+        // wake up and fail any waiting Back() or Front()
+        void Stop(void)
+        {
+                _stop.store(1, std::memory_order_relaxed);
+        }
+};
+
+#endif
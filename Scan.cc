@@ -0,0 +1,197 @@
+#include "Scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#define S CC_SPACE
+#define D CC_DIGIT
+#define A CC_ALPHA
+
+const unsigned char char_class[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0,         // 0x00
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 0x10
+        S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // 0x20
+        D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,         // 0x30
+        0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,         // 0x40
+        A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,         // 0x50
+        0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,         // 0x60
+        A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,         // 0x70
+};
+
+#undef S
+#undef D
+#undef A
+
+// widest scan code path allowed
+static int scan_max = SCAN_AVX2;
+
+// scalar scan: skip bytes whose class intersects mask
+static size_t scan_tail(const char *p, size_t i, size_t n, int mask)
+{
+        while (i < n && (char_class[(unsigned char)p[i]] & mask))
+                i++;
+        return i;
+}
+
+#ifdef SCAN_X86
+
+// which bytes of a 16 byte block are in [lo, hi]
+//
+// SSE2 has only signed byte compares, so bias the range down to start
+// at -128 and compare once
+static inline __m128i in_range16(__m128i v, char lo, char hi)
+{
+        auto t = _mm_add_epi8(v, _mm_set1_epi8((char)(-128 - lo)));
+        return _mm_cmplt_epi8(t, _mm_set1_epi8((char)(-128 + (hi - lo) + 1)));
+}
+
+static inline __m128i space16(__m128i v)
+{
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                        in_range16(v, '\t', '\r'));
+}
+
+static inline __m128i digit16(__m128i v)
+{
+        return in_range16(v, '0', '9');
+}
+
+static inline __m128i ident16(__m128i v)
+{
+        // fold case so one range test covers both 'a'-'z' and 'A'-'Z'
+        auto lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        return _mm_or_si128(_mm_or_si128(in_range16(lower, 'a', 'z'),
+                                digit16(v)),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+// skip 16 bytes at a time while every byte is in class
+#define SCAN16(name, classify)                                          \
+static size_t name(const char *p, size_t i, size_t n)                   \
+{                                                                       \
+        for (; i + 16 <= n; i += 16) {                                  \
+                auto v = _mm_loadu_si128((const __m128i *)(p + i));     \
+                unsigned m = ~_mm_movemask_epi8(classify(v)) & 0xffff;  \
+                if (m != 0)                                             \
+                        return i + __builtin_ctz(m);                    \
+        }                                                               \
+        return i;                                                       \
+}
+
+SCAN16(space_sse2, space16)
+SCAN16(ident_sse2, ident16)
+SCAN16(digits_sse2, digit16)
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i in_range32(__m256i v, char lo, char hi)
+{
+        auto t = _mm256_add_epi8(v, _mm256_set1_epi8((char)(-128 - lo)));
+        return _mm256_cmpgt_epi8(
+                        _mm256_set1_epi8((char)(-128 + (hi - lo) + 1)), t);
+}
+
+AVX2 static inline __m256i space32(__m256i v)
+{
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                        in_range32(v, '\t', '\r'));
+}
+
+AVX2 static inline __m256i digit32(__m256i v)
+{
+        return in_range32(v, '0', '9');
+}
+
+AVX2 static inline __m256i ident32(__m256i v)
+{
+        auto lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        return _mm256_or_si256(_mm256_or_si256(in_range32(lower, 'a', 'z'),
+                                digit32(v)),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+// skip 32 bytes at a time while every byte is in class
+#define SCAN32(name, classify)                                          \
+AVX2 static size_t name(const char *p, size_t i, size_t n)              \
+{                                                                       \
+        for (; i + 32 <= n; i += 32) {                                  \
+                auto v = _mm256_loadu_si256((const __m256i *)(p + i));  \
+                unsigned m = ~(unsigned)_mm256_movemask_epi8(classify(v)); \
+                if (m != 0)                                             \
+                        return i + __builtin_ctz(m);                    \
+        }                                                               \
+        return i;                                                       \
+}
+
+SCAN32(space_avx2, space32)
+SCAN32(ident_avx2, ident32)
+SCAN32(digits_avx2, digit32)
+
+typedef size_t (*scanfn)(const char *, size_t, size_t);
+
+static int have_avx2(void)
+{
+        static int avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+}
+
+// run the widest vector scan the cpu has, then finish with sse2 and
+// scalar code for whatever is left
+static inline size_t scan(const char *p, size_t i, size_t n, int mask,
+                scanfn wide, scanfn narrow)
+{
+        if (scan_max == SCAN_SCALAR)
+                return scan_tail(p, i, n, mask);
+        if (scan_max == SCAN_AVX2 && have_avx2())
+                i = wide(p, i, n);
+        i = narrow(p, i, n);
+        if (i + 16 <= n)
+                return i;
+        return scan_tail(p, i, n, mask);
+}
+
+#endif
+
+int scan_limit(int isa)
+{
+        scan_max = isa;
+#ifdef SCAN_X86
+        if (isa == SCAN_AVX2 && !have_avx2())
+                return SCAN_SSE2;
+        return isa;
+#else
+        return SCAN_SCALAR;
+#endif
+}
+
+size_t scan_space(const char *p, size_t i, size_t n)
+{
+        // most gaps between tokens are a single space
+        if (i < n && !(char_class[(unsigned char)p[i]] & CC_SPACE))
+                return i;
+#ifdef SCAN_X86
+        return scan(p, i, n, CC_SPACE, space_avx2, space_sse2);
+#else
+        return scan_tail(p, i, n, CC_SPACE);
+#endif
+}
+
+size_t scan_ident(const char *p, size_t i, size_t n)
+{
+#ifdef SCAN_X86
+        return scan(p, i, n, CC_ALPHA | CC_DIGIT, ident_avx2, ident_sse2);
+#else
+        return scan_tail(p, i, n, CC_ALPHA | CC_DIGIT);
+#endif
+}
+
+size_t scan_digits(const char *p, size_t i, size_t n)
+{
+#ifdef SCAN_X86
+        return scan(p, i, n, CC_DIGIT, digits_avx2, digits_sse2);
+#else
+        return scan_tail(p, i, n, CC_DIGIT);
+#endif
+}
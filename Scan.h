@@ -0,0 +1,50 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+
+// character classes
+enum {
+        CC_SPACE = 1,   // ' ', '\t', '\n', '\v', '\f', '\r'
+        CC_DIGIT = 2,   // '0' - '9'
+        CC_ALPHA = 4,   // 'a' - 'z', 'A' - 'Z', '_'
+};
+
+// scan code paths, narrowest first
+enum {
+        SCAN_SCALAR,    // a byte at a time
+        SCAN_SSE2,      // 16 bytes at a time
+        SCAN_AVX2,      // 32 bytes at a time
+};
+
+// character class of every byte
+extern const unsigned char char_class[256];
+
+// find first non-whitespace byte
+//
+// @p:  start of buffer
+// @i:  offset to start scanning at
+// @n:  length of buffer
+extern size_t scan_space(const char *p, size_t i, size_t n);
+
+// find first byte that cannot continue an identifier
+//
+// @p:  start of buffer
+// @i:  offset to start scanning at
+// @n:  length of buffer
+extern size_t scan_ident(const char *p, size_t i, size_t n);
+
+// find first non-digit byte
+//
+// @p:  start of buffer
+// @i:  offset to start scanning at
+// @n:  length of buffer
+extern size_t scan_digits(const char *p, size_t i, size_t n);
+
+// use no scan code path wider than isa, for benchmarking; not to be
+// called while lexing. returns the widest path the cpu will now use
+//
+// @isa:        SCAN_*
+extern int scan_limit(int isa);
+
+#endif
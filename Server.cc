@@ -0,0 +1,105 @@
+#include "Compiler.h"
+#include "Server.h"
+#include "Wire.h"
+#include <csignal>
+#include <exception>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+Server::Server(const std::string &path)
+        : _path {path},
+        _fd {socket(AF_UNIX, SOCK_STREAM, 0)}
+{
+        struct sockaddr_un addr {};
+
+        if (_fd < 0)
+                error("could not create socket");
+
+        if (path.size() >= sizeof(addr.sun_path))
+                usage("socket path too long: %s", path.c_str());
+
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        unlink(path.c_str());
+
+        if (bind(_fd, reinterpret_cast<struct sockaddr *>(&addr),
+                                sizeof(addr)) < 0)
+                error("could not bind %s", path.c_str());
+
+        if (listen(_fd, SOMAXCONN) < 0)
+                error("could not listen on %s", path.c_str());
+}
+
+void Server::Run(void)
+{
+        // a client hanging up mid reply must not kill the server; the
+        // write fails with EPIPE instead and drops that connection
+        signal(SIGPIPE, SIG_IGN);
+
+        for (;;) {
+                auto fd = accept(_fd, nullptr, nullptr);
+                if (fd < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED)
+                                continue;
+                        error("could not accept on %s", _path.c_str());
+                }
+                std::thread{&Server::serve, this, fd}.detach();
+        }
+}
+
+void Server::serve(int fd)
+{
+        std::string body;
+        std::string out;
+        int kind;
+        int r;
+
+        while ((r = read_msg(fd, kind, body, MSG_MAX)) > 0) {
+                if (kind != MSG_PATH && kind != MSG_SOURCE) {
+                        static const char msg[] = "bad request";
+                        write_msg(fd, MSG_ERROR, msg, sizeof(msg) - 1);
+                        break;
+                }
+
+                auto ispath = kind == MSG_PATH;
+                kind = MSG_ASM;
+                try {
+                        compile(ispath, body, out);
+                } catch (const std::exception &e) {
+                        kind = MSG_ERROR;
+                        out = e.what();
+                }
+                if (write_msg(fd, kind, out.data(), out.size()) < 0)
+                        break;
+        }
+        if (r == -2) {
+                static const char msg[] = "request too large";
+                write_msg(fd, MSG_ERROR, msg, sizeof(msg) - 1);
+        }
+
+        close(fd);
+}
+
+void Server::compile(int ispath, const std::string &body, std::string &out)
+{
+        std::unique_ptr<Compiler> c;
+
+        if (ispath) {
+                // read the file here; the output stays in memory
+                Source src {body};
+                c.reset(new Compiler{body, src.Buf(), src.Len()});
+        } else {
+                c.reset(new Compiler{"<request>", body.data(), body.size()});
+        }
+
+        c->Run();
+        out.assign(c->Out().Data(), c->Out().Size());
+}
+
+Server::~Server()
+{
+        close(_fd);
+        unlink(_path.c_str());
+}
@@ -0,0 +1,42 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "Error.h"
+#include <string>
+
+// compile server
+//
+// listens on a unix socket and answers MSG_PATH and MSG_SOURCE requests
+// with the generated assembly, or with MSG_ERROR if the input does not
+// compile. a client may send any number of requests on one connection,
+// and every connection is served on its own thread. the interner stays
+// warm between requests, so identifiers seen before cost a lookup rather
+// than an insert
+class Server {
+private:
+        std::string     _path;  // path name of socket
+        int             _fd;    // listening socket
+
+        // answer requests on a connection until the client hangs up
+        void serve(int fd);
+
+        // compile a request into assembly
+        //
+        // @ispath:     is body a path name rather than source text?
+        // @body:       body of request
+        // @out:        set to generated assembly
+        void compile(int ispath, const std::string &body, std::string &out);
+public:
+        // @path:       path name of socket to listen on
+        Server(const std::string &path);
+
+        Server(const Server &) = delete;
+        Server &operator=(const Server &) = delete;
+
+        // accept connections forever
+        void Run(void);
+
+        ~Server();
+};
+
+#endif
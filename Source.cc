@@ -0,0 +1,94 @@
+#include "Source.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Source::Source(const std::string &path)
+        : _path {path},
+        _data {},
+        _buf {""},
+        _len {0},
+        _mapped {0}
+{
+        struct stat st;
+        int fd;
+
+        if ((fd = open(path.c_str(), O_RDONLY)) < 0)
+                error("could not open: %s", path.c_str());
+
+        if (fstat(fd, &st) < 0)
+                error("could not stat: %s", path.c_str());
+
+        if (S_ISREG(st.st_mode) && st.st_size > 0) {
+                auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE,
+                                fd, 0);
+                if (p != MAP_FAILED) {
+                        _buf = static_cast<const char *>(p);
+                        _len = st.st_size;
+                        _mapped = 1;
+                }
+        }
+
+        if (!_mapped)
+                slurp(fd);
+
+        if (close(fd) < 0)
+                error("could not close %s", path.c_str());
+}
+
+Source::Source(const std::string &name, const char *buf, size_t len)
+        : _path {name},
+        _data(buf, buf + len),
+        _buf {len > 0 ? _data.data() : ""},
+        _len {len},
+        _mapped {0}
+{}
+
+void Source::slurp(int fd)
+{
+        size_t n {0};
+        ssize_t got;
+
+        _data.resize(1 << 16);
+        for (;;) {
+                if (n == _data.size())
+                        _data.resize(_data.size() * 2);
+                got = read(fd, _data.data() + n, _data.size() - n);
+                if (got < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        error("could not read: %s", _path.c_str());
+                }
+                if (got == 0)
+                        break;
+                n += got;
+        }
+
+        _data.resize(n);
+        _buf = n > 0 ? _data.data() : "";
+        _len = n;
+}
+
+const char *Source::Buf(void) const
+{
+        return _buf;
+}
+
+size_t Source::Len(void) const
+{
+        return _len;
+}
+
+const std::string &Source::Path(void) const
+{
+        return _path;
+}
+
+Source::~Source()
+{
+        // nothing to report from a destructor; the mapping goes away
+        // with the process anyway
+        if (_mapped)
+                munmap(const_cast<char *>(_buf), _len);
+}
@@ -0,0 +1,44 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "Error.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// source buffer holding the whole input file
+class Source {
+private:
+        std::string             _path;  // path name of file being read
+        std::vector<char>       _data;  // buffer when input is not mapped
+        const char              *_buf;  // start of input
+        size_t                  _len;   // length of input
+        int                     _mapped;// is _buf mmap'd?
+
+        // read whole file into _data (used for pipes and ttys)
+        void slurp(int fd);
+public:
+        // @path:       path name of file to read
+        Source(const std::string &path);
+
+        // @name:       name to report input by
+        // @buf:        source text, copied
+        // @len:        length of source text
+        Source(const std::string &name, const char *buf, size_t len);
+
+        Source(const Source &) = delete;
+        Source &operator=(const Source &) = delete;
+
+        // get start of input
+        const char *Buf(void) const;
+
+        // get length of input
+        size_t Len(void) const;
+
+        // get path name of input
+        const std::string &Path(void) const;
+
+        ~Source();
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Sym.h"
+#include "Type.h"
 
 static void argsok(int prim, int stype)
 {
@@ -27,26 +28,44 @@ static void argsok(int prim, int stype)
         }
 }
 
-Sym::Sym(int prim, int stype, int end, const std::string &name)
+Sym::Sym(void)
+        : _name {0},
+        _prim {TYPE_NONE},
+        _stype {STYPE_VAR},
+        _end {0},
+        _size {0},
+        _off {0},
+        _frame {0},
+        _ref {0}
+{}
+
+Sym::Sym(int prim, int stype, int end, Ident name)
         : _name {name},
         _prim {prim},
         _stype {stype},
-        _end {end}
+        _end {end},
+        _size {0},
+        _off {0},
+        _frame {0},
+        _ref {0}
 {
         argsok(_prim, _stype);
 }
 
-Sym::Sym(int prim, int stype, int end, const std::string &name, int size)
+Sym::Sym(int prim, int stype, int end, Ident name, int size)
         : _name {name},
         _prim {prim},
         _stype {stype},
         _end {end},
-        _size {size}
+        _size {size},
+        _off {0},
+        _frame {0},
+        _ref {0}
 {
         argsok(_prim, _stype);
 }
 
-std::string Sym::Name(void) const
+Ident Sym::Name(void) const
 {
         return _name;
 }
@@ -65,3 +84,45 @@ int Sym::End(void) const
 {
         return _end;
 }
+
+SymRef Sym::Ref(void) const
+{
+        return _ref;
+}
+
+void Sym::SetRef(SymRef ref)
+{
+        _ref = ref;
+}
+
+int Sym::Size(void) const
+{
+        return _size;
+}
+
+int Sym::Local(void) const
+{
+        return _off != 0;
+}
+
+int Sym::Off(void) const
+{
+        return _off;
+}
+
+void Sym::SetOff(int off)
+{
+        if (off >= 0)
+                usage("invalid frame offset: %d", off);
+        _off = off;
+}
+
+int Sym::Frame(void) const
+{
+        return _frame;
+}
+
+void Sym::SetFrame(int size)
+{
+        _frame = size;
+}
@@ -2,27 +2,38 @@
 #define SYM_H
 
 #include "Error.h"
-#include "Type.h"
+#include "Intern.h"
+#include <cstdint>
 #include <string>
 
+// index of symbol in its SymTab
+typedef uint32_t SymRef;
+
 // symbol
 class Sym {
 private:
-        std::string     _name;  // symbol name
+        Ident           _name;  // symbol name
         int             _prim;  // primitive type
         int             _stype; // structural type
         int             _end;   // end label for functions
         int             _size;  // number of elements for array
+        int             _off;   // offset from %rbp of local variable,
+                                // 0 for globals
+        int             _frame; // bytes of local variables of function
+        SymRef          _ref;   // index in symbol table
 public:
+        // empty symbol
+        Sym(void);
+
         // @name:       symbol name
         // @prim:       primitive type
         // @stype:      structural type
-        Sym(int prim, int stype, int end, const std::string &name);
+        Sym(int prim, int stype, int end, Ident name);
 
-        Sym(int prim, int stype, int end, const std::string &name, int size);
+        Sym(int prim, int stype, int end, Ident name, int size);
 
         // get symbol name
-        std::string Name(void) const;
+        Ident Name(void) const;
 
         int Prim(void) const;
 
@@ -30,7 +41,31 @@ public:
 
         int End(void) const;
 
-        int Size(void);
+        // get index in symbol table
+        SymRef Ref(void) const;
+
+        // set index in symbol table
+        void SetRef(SymRef ref);
+
+        // get number of elements of array
+        int Size(void) const;
+
+        // is symbol a local variable?
+        int Local(void) const;
+
+        // get offset from %rbp of local variable
+        int Off(void) const;
+
+        // make symbol a local variable
+        //
+        // @off:        offset from %rbp, below 0
+        void SetOff(int off);
+
+        // get bytes of local variables of function
+        int Frame(void) const;
+
+        // set bytes of local variables of function
+        void SetFrame(int size);
 };
 
 #endif
@@ -1,27 +1,158 @@
 #include "SymTab.h"
+#include "Mem.h"
 
-void SymTab::Set(const std::string &name, Sym *sym)
+// first table size
+static constexpr size_t SLOTS0 = 64;
+
+// name of empty slot; the interner never hands out this id
+static constexpr Ident NO_NAME = (Ident)-1;
+
+// spread interned ids, which are handed out in runs, over the table
+static inline size_t hash(Ident name)
+{
+        return (uint32_t)(name * 0x9e3779b1u);
+}
+
+// split index of a symbol into pool chunk and offset in chunk
+static inline void chunk_of(uint32_t i, unsigned first, unsigned *chunk,
+                uint32_t *off)
 {
-        auto p = _tab.find(name);
+        auto biased = i + (1u << first);
+        auto top = 31 - __builtin_clz(biased);
 
-        if (p != _tab.end())
-                usage("%s already in symbol table", name.c_str());
+        *chunk = top - first;
+        *off = biased - (1u << top);
+}
+
+SymTab::SymTab(void)
+        : _slots(SLOTS0, Slot{NO_NAME, 0, nullptr}),
+        _used {0},
+        _chunks {},
+        _nsyms {0},
+        _outer {},
+        _scopes {}
+{}
 
-        _tab[name] = sym;
+const SymTab::Slot *SymTab::find(Ident name) const
+{
+        auto mask = _slots.size() - 1;
+
+        for (auto i = hash(name) & mask; ; i = (i + 1) & mask) {
+                auto &s = _slots[i];
+                if (s.name == NO_NAME)
+                        return nullptr;
+                if (s.name == name)
+                        return &s;
+        }
 }
 
-Sym *SymTab::Get(const std::string &name)
+SymTab::Slot &SymTab::slot(Ident name)
 {
-        auto p = _tab.find(name);
+        // keep the table at most half full
+        if (2 * (_used + 1) > _slots.size())
+                grow();
+
+        auto mask = _slots.size() - 1;
+
+        for (auto i = hash(name) & mask; ; i = (i + 1) & mask) {
+                auto &s = _slots[i];
+                if (s.name == name)
+                        return s;
+                if (s.name == NO_NAME) {
+                        s.name = name;
+                        _used++;
+                        return s;
+                }
+        }
+}
+
+void SymTab::grow(void)
+{
+        std::vector<Slot> old(_slots.size() * 2, Slot{NO_NAME, 0, nullptr});
+        old.swap(_slots);
+
+        auto mask = _slots.size() - 1;
+        for (auto &s : old) {
+                if (s.name == NO_NAME)
+                        continue;
+                auto i = hash(s.name) & mask;
+                while (_slots[i].name != NO_NAME)
+                        i = (i + 1) & mask;
+                _slots[i] = s;
+        }
+}
+
+Sym *SymTab::Set(Ident name, const Sym &sym)
+{
+        MemTag mt {MEM_SYM};
+        auto &s = slot(name);
+        auto first = _scopes.empty() ? 0 : _scopes.back();
+        unsigned chunk;
+        uint32_t off;
+
+        if (s.idx != 0 && s.idx - 1 >= first)
+                usage("%s already in symbol table", interner.Name(name));
 
-        if (p == _tab.end())
-                usage("%s not in symbol table", name.c_str());
+        if (_nsyms >= (1u << 31))
+                usage("too many symbols");
+
+        chunk_of(_nsyms, CHUNK0_BITS, &chunk, &off);
+        auto c = _chunks[chunk].load(std::memory_order_relaxed);
+        if (c == nullptr) {
+                c = new Sym[1u << (chunk + CHUNK0_BITS)];
+                _chunks[chunk].store(c, std::memory_order_release);
+        }
+
+        c[off] = sym;
+        c[off].SetRef(_nsyms);
+        _outer.push_back(s.idx);
+        s.idx = ++_nsyms;
+        s.sym = &c[off];
+        return s.sym;
+}
+
+Sym *SymTab::Get(Ident name)
+{
+        auto s = find(name);
+
+        if (s == nullptr || s->idx == 0)
+                usage("%s not in symbol table", interner.Name(name));
+
+        return s->sym;
+}
+
+Sym *SymTab::At(SymRef ref) const
+{
+        unsigned chunk;
+        uint32_t off;
+
+        chunk_of(ref, CHUNK0_BITS, &chunk, &off);
+        return &_chunks[chunk].load(std::memory_order_acquire)[off];
+}
+
+void SymTab::Push(void)
+{
+        MemTag mt {MEM_SYM};
+
+        _scopes.push_back(_nsyms);
+}
+
+void SymTab::Pop(void)
+{
+        if (_scopes.empty())
+                usage("no scope to pop");
 
-        return p->second;
+        // newest first, so each name gets back the symbol it shadowed
+        for (auto i = _nsyms; i > _scopes.back(); i--) {
+                auto &s = slot(At(i - 1)->Name());
+                s.idx = _outer[i - 1];
+                s.sym = s.idx ? At(s.idx - 1) : nullptr;
+        }
+        _scopes.pop_back();
 }
 
 SymTab::~SymTab()
 {
-        for (auto p : _tab)
-                delete p.second;
+        for (auto &c : _chunks)
+                delete[] c.load(std::memory_order_relaxed);
 }
@@ -2,21 +2,80 @@
 #define SYMTAB_H
 
 #include "Error.h"
+#include "Intern.h"
 #include "Sym.h"
-#include <string>
-#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 // symbol table
+//
+// an open addressed table from interned identifier to the innermost
+// symbol of that name. symbols live in a pool and are never moved, so a
+// Sym * or SymRef stays good for as long as the table. a symbol declared
+// in an inner scope shadows the outer one until the scope is popped.
+//
+// only one thread may declare and look up names, but At() takes no lock
+// and may be called from any thread for any symbol made before
 class SymTab {
 private:
-        std::unordered_map<std::string,Sym*>    _tab;   // symbol table
+        // first pool chunk holds 1 << CHUNK0_BITS symbols, each next
+        // chunk is twice as big as the one before it
+        static constexpr unsigned CHUNK0_BITS = 6;
+        static constexpr unsigned NCHUNKS = 32 - CHUNK0_BITS;
+
+        // table slot; a name keeps its slot once it has one, so nothing
+        // is ever deleted from the table
+        struct Slot {
+                Ident           name;   // identifier
+                uint32_t        idx;    // index of innermost symbol + 1,
+                                        // 0 if none in scope
+                Sym             *sym;   // innermost symbol
+        };
+
+        std::vector<Slot>       _slots;  // open addressed, power of 2
+        size_t                  _used;   // slots with a name
+        std::atomic<Sym *>      _chunks[NCHUNKS]; // symbol pool
+        uint32_t                _nsyms;  // symbols in pool
+        std::vector<uint32_t>   _outer;  // per symbol: symbol it shadows
+                                         // + 1, or 0
+        std::vector<size_t>     _scopes; // per open scope: first symbol
+
+        // get slot of name, claiming an empty one if name has none
+        Slot &slot(Ident name);
+
+        // find slot of name or null
+        const Slot *find(Ident name) const;
+
+        // double number of slots
+        void grow(void);
 public:
-        ~SymTab();
-        // add symbol to table
-        void Set(const std::string &name, Sym *sym);
+        SymTab(void);
+
+        SymTab(const SymTab &) = delete;
+        SymTab &operator=(const SymTab &) = delete;
 
-        // get symbol from table
-        Sym *Get(const std::string &name);
+        // add symbol to innermost scope
+        //
+        // @name:       symbol name
+        // @sym:        symbol, copied into pool
+        // @return:     symbol in pool
+        Sym *Set(Ident name, const Sym &sym);
+
+        // get innermost symbol of name from table
+        Sym *Get(Ident name);
+
+        // get symbol by index
+        Sym *At(SymRef ref) const;
+
+        // open a scope
+        void Push(void);
+
+        // close innermost scope, unbinding its names; its symbols stay
+        // in the pool until the table goes away
+        void Pop(void);
+
+        ~SymTab();
 };
 
 #endif
@@ -0,0 +1,290 @@
+#include "Synth.h"
+#include "Type.h"
+#include <cstdlib>
+
+// number of recent globals functions may use
+#define SYNTH_GLOBALS   64
+
+// elements of the array of each function, at least the most trips a loop
+// makes
+#define SYNTH_ELEMS     16
+
+static const char *prim_name(int prim)
+{
+        switch (prim) {
+        case TYPE_CHAR:
+                return "char";
+        case TYPE_INT:
+                return "int";
+        default:
+                return "long";
+        }
+}
+
+Synth::Synth(FILE *fp, uint64_t seed)
+        : _fp {fp},
+        _rng {seed},
+        _stats {},
+        _glo {},
+        _loc {},
+        _suffix {}
+{}
+
+uint64_t Synth::rand(uint64_t n)
+{
+        // splitmix64
+        uint64_t z = (_rng += 0x9e3779b97f4a7c15ull);
+
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return (z ^ (z >> 31)) % n;
+}
+
+void Synth::put(const std::string &s)
+{
+        if (fwrite(s.data(), 1, s.size(), _fp) != s.size())
+                error("could not write program");
+
+        _stats.bytes += s.size();
+        for (auto c : s)
+                _stats.lines += c == '\n';
+}
+
+const Synth::Var *Synth::pick(int prim)
+{
+        std::vector<const Var *> ok;
+
+        for (auto &v : _loc) {
+                if (v.prim <= prim)
+                        ok.push_back(&v);
+        }
+        for (auto &v : _glo) {
+                if (v.prim <= prim)
+                        ok.push_back(&v);
+        }
+        if (ok.empty())
+                return nullptr;
+        return ok[rand(ok.size())];
+}
+
+std::string Synth::lit(int prim)
+{
+        // literals below 256 are chars, the rest ints
+        if (prim == TYPE_CHAR || rand(2))
+                return std::to_string(rand(256));
+        return std::to_string(256 + rand(100000));
+}
+
+std::string Synth::trips(void)
+{
+        // loops nest three deep, so keep running the program quick
+        return std::to_string(1 + rand(16));
+}
+
+std::string Synth::expr(int prim)
+{
+        static const char *ops[] = {" + ", " - ", " * "};
+        std::string s;
+        auto n = 1 + rand(3);
+
+        // a chain of terms needs at most three registers
+        for (uint64_t i = 0; i < n; i++) {
+                if (i)
+                        s += ops[rand(3)];
+
+                auto v = pick(prim);
+                switch (v ? rand(prim == TYPE_LONG ? 6 : 5) : 0) {
+                case 0:
+                        s += lit(prim);
+                        break;
+                case 1:
+                case 2:
+                        s += v->name;
+                        break;
+                case 3:
+                        s += v->name + " * " + lit(TYPE_CHAR);
+                        break;
+                case 4:
+                        s += v->name + " / " + std::to_string(1 + rand(9));
+                        break;
+                case 5:
+                        s += "v" + _suffix + "[" +
+                                std::to_string(rand(SYNTH_ELEMS)) + "]";
+                        break;
+                }
+        }
+
+        return s;
+}
+
+void Synth::assign(int depth)
+{
+        auto &v = _loc[rand(_loc.size())];
+
+        put(std::string(depth, '\t') + v.name + " = " + expr(v.prim) + ";\n");
+}
+
+void Synth::stmts(int depth, int n)
+{
+        static const char *cmps[] = {" < ", " > ", " <= ", " >= ", " == ",
+                                        " != "};
+        std::string tab(depth, '\t');
+
+        for (int i = 0; i < n; i++) {
+                // loops and ifs nest at most two deep
+                switch (depth < 3 ? rand(8) : 0) {
+                case 0:
+                case 1:
+                case 2:
+                        assign(depth);
+                        break;
+                case 3: {
+                        // every loop gets its own counter
+                        auto c = "i" + _suffix + "_" + std::to_string(depth);
+                        put(tab + "for (" + c + " = 0; " + c + " < " +
+                                trips() + "; " + c + " = " + c +
+                                " + 1) {\n");
+                        // walk the array the way real loops do
+                        if (rand(2)) {
+                                auto e = "v" + _suffix + "[" + c + "]";
+                                put(tab + "\t" + e + " = " + e + " + " +
+                                        expr(TYPE_LONG) + ";\n");
+                        }
+                        stmts(depth + 1, 1 + rand(3));
+                        put(tab + "}\n");
+                        break;
+                }
+                case 4: {
+                        auto c = "w" + _suffix + "_" + std::to_string(depth);
+                        put(tab + c + " = 0;\n" +
+                                tab + "while (" + c + " < " +
+                                trips() + ") {\n" +
+                                tab + "\t" + c + " = " + c + " + 1;\n");
+                        stmts(depth + 1, rand(3));
+                        put(tab + "}\n");
+                        break;
+                }
+                case 5:
+                        // comparisons bind tighter than arithmetic
+                        put(tab + "if ((" + expr(TYPE_LONG) + ")" +
+                                cmps[rand(6)] + "(" + expr(TYPE_LONG) +
+                                ")) {\n");
+                        stmts(depth + 1, 1 + rand(3));
+                        if (rand(2)) {
+                                put(tab + "} else {\n");
+                                stmts(depth + 1, 1 + rand(3));
+                        }
+                        put(tab + "}\n");
+                        break;
+                case 6:
+                        put(tab + "*p" + _suffix + " = *p" + _suffix + " + " +
+                                expr(TYPE_LONG) + ";\n");
+                        break;
+                case 7:
+                        put(tab + "printint(" + expr(TYPE_LONG) + ");\n");
+                        break;
+                }
+        }
+}
+
+void Synth::func(void)
+{
+        static const int prims[] = {TYPE_CHAR, TYPE_INT, TYPE_LONG};
+        _suffix = "_" + std::to_string(_stats.funcs);
+
+        int gprim = prims[rand(3)];
+        put(std::string{prim_name(gprim)} + " g" + _suffix + ";\n");
+        if (_glo.size() == SYNTH_GLOBALS)
+                _glo.erase(_glo.begin() + rand(SYNTH_GLOBALS));
+        _glo.push_back(Var{"g" + _suffix, gprim});
+
+        _loc = {
+                {"a" + _suffix, TYPE_LONG},
+                {"b" + _suffix, TYPE_LONG},
+                {"n" + _suffix, TYPE_INT},
+                {"c" + _suffix, TYPE_CHAR},
+        };
+
+        put("long fn" + _suffix + "()\n"
+            "{\n"
+            "\tlong a" + _suffix + ", b" + _suffix + ";\n"
+            "\tint n" + _suffix + ";\n"
+            "\tchar c" + _suffix + ";\n"
+            "\tlong *p" + _suffix + ";\n"
+            "\tlong v" + _suffix + "[" + std::to_string(SYNTH_ELEMS) +
+                "];\n"
+            "\tint i" + _suffix + "_1, i" + _suffix + "_2, i" + _suffix +
+                "_3;\n"
+            "\tint w" + _suffix + "_1, w" + _suffix + "_2, w" + _suffix +
+                "_3;\n"
+            "\n"
+            "\tp" + _suffix + " = &b" + _suffix + ";\n");
+
+        // locals start out as whatever is on the stack
+        for (auto &v : _loc)
+                put("\t" + v.name + " = 0;\n");
+        put("\tfor (i" + _suffix + "_1 = 0; i" + _suffix + "_1 < " +
+                std::to_string(SYNTH_ELEMS) + "; i" + _suffix + "_1 = i" +
+                _suffix + "_1 + 1) {\n"
+            "\t\tv" + _suffix + "[i" + _suffix + "_1] = 0;\n"
+            "\t}\n");
+
+        stmts(1, 2 + rand(8));
+
+        // call one function before this one, so calls never recurse and
+        // running the program takes time linear in its size
+        if (_stats.funcs) {
+                auto callee = std::to_string(rand(_stats.funcs));
+                put("\ta" + _suffix + " = fn_" + callee + "(" +
+                        expr(TYPE_LONG) + ");\n");
+        }
+
+        put("\treturn (" + expr(TYPE_LONG) + ");\n"
+            "}\n"
+            "\n");
+
+        _loc.clear();
+        _stats.funcs++;
+}
+
+SynthStats Synth::Write(size_t size)
+{
+        do {
+                func();
+        } while (_stats.bytes < size);
+
+        put("void main()\n"
+            "{\n"
+            "\tprintint(fn_" + std::to_string(_stats.funcs - 1) +
+                "(1));\n"
+            "}\n");
+        _stats.funcs++;
+
+        return _stats;
+}
+
+size_t parse_size(const char *s)
+{
+        char *end;
+        auto n = strtoull(s, &end, 10);
+
+        switch (*end) {
+        case 'k':
+        case 'K':
+                n <<= 10;
+                end++;
+                break;
+        case 'm':
+        case 'M':
+                n <<= 20;
+                end++;
+                break;
+        case 'g':
+        case 'G':
+                n <<= 30;
+                end++;
+                break;
+        }
+
+        return *end == '\0' ? n : 0;
+}
@@ -0,0 +1,83 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include "Error.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// what a synthetic program is made of
+struct SynthStats {
+        size_t  bytes;  // size of source text
+        size_t  lines;  // number of lines
+        size_t  funcs;  // number of functions
+};
+
+// synthetic program generator
+//
+// writes valid programs of any size for benchmarking: globals, pointers,
+// arrays walked by loops, for/while/if and calls. every name is unique
+// since all variables are global, functions only call the ones before
+// them so nothing recurses, values are only ever assigned to variables at
+// least as wide, and expressions are kept shallow enough for the four
+// scratch registers
+class Synth {
+private:
+        // variable
+        struct Var {
+                std::string     name;   // name
+                int             prim;   // primitive type
+        };
+
+        FILE            *_fp;   // output
+        uint64_t        _rng;   // random state
+        SynthStats      _stats; // what was written so far
+        std::vector<Var> _glo;  // global scalars
+        std::vector<Var> _loc;  // locals of function being written
+        std::string     _suffix;// added to names of function being written
+
+        // get random number below n
+        uint64_t rand(uint64_t n);
+
+        // write text
+        void put(const std::string &s);
+
+        // pick a variable no wider than prim
+        const Var *pick(int prim);
+
+        // make an integer literal no wider than prim
+        std::string lit(int prim);
+
+        // make a loop trip count
+        std::string trips(void);
+
+        // make an expression no wider than prim
+        std::string expr(int prim);
+
+        // write an assignment
+        void assign(int depth);
+
+        // write statements
+        void stmts(int depth, int n);
+
+        // write a function
+        void func(void);
+public:
+        // @fp:         file to write to
+        // @seed:       seed of random choices
+        Synth(FILE *fp, uint64_t seed);
+
+        // write a program of at least size bytes
+        //
+        // @size:       size of source text wanted
+        SynthStats Write(size_t size);
+};
+
+// parse size with optional K, M or G suffix, or return 0 if bad
+//
+// @s:          size
+extern size_t parse_size(const char *s);
+
+#endif
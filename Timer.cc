@@ -0,0 +1,343 @@
+#include "Timer.h"
+#include "Mem.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+TimeReport timereport;
+
+// number of functions Print() lists
+#define SLOWEST 10
+
+static const char *phase_names[NPHASES] = {
+        "none", "lex", "parse", "type", "gen", "write",
+};
+
+// timing state of a thread
+struct Clock {
+        int             phase;  // phase being timed
+        int             depth;  // number of phase timers running
+        uint64_t        start;  // wall clock when time was last charged
+        uint64_t        cpu;    // thread cpu time at outermost timer
+        Times           t;      // time charged since outermost timer
+        FuncTimer       *func;  // function being timed or null
+};
+
+static thread_local Clock clk;
+
+static uint64_t now(clockid_t id)
+{
+        struct timespec ts;
+
+        clock_gettime(id, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// split cpu time between phases by their wall clock time
+static void split(Times &t, uint64_t cpu)
+{
+        uint64_t wall {0};
+
+        for (int i = 0; i < NPHASES; i++)
+                wall += t.wall[i];
+        for (int i = 0; i < NPHASES; i++)
+                t.cpu[i] = wall ? (uint64_t)((double)cpu * t.wall[i] / wall)
+                                : 0;
+}
+
+static uint64_t sum(const uint64_t *v)
+{
+        uint64_t n {0};
+
+        for (int i = 0; i < NPHASES; i++)
+                n += v[i];
+        return n;
+}
+
+static double ms(uint64_t ns)
+{
+        return ns / 1e6;
+}
+
+TimeReport::TimeReport(void)
+        : _on {0},
+        _lock {},
+        _total {},
+        _funcs {},
+        _wall {0},
+        _cpu {0}
+{}
+
+void TimeReport::Enable(void)
+{
+        _wall = now(CLOCK_MONOTONIC);
+        _cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+        _on.store(1, std::memory_order_relaxed);
+}
+
+FuncTimes *TimeReport::Func(Ident name)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+
+        _funcs.push_back(FuncTimes{name, Times{}, 0, 0});
+        return &_funcs.back();
+}
+
+void TimeReport::Add(const Times &t, FuncTimes *f)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+        auto &to = f ? f->t : _total;
+
+        for (int i = 0; i < NPHASES; i++) {
+                to.wall[i] += t.wall[i];
+                to.cpu[i] += t.cpu[i];
+        }
+}
+
+void TimeReport::AddAllocs(FuncTimes *f, uint64_t allocs, uint64_t bytes)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+
+        f->allocs += allocs;
+        f->bytes += bytes;
+}
+
+Times TimeReport::Totals(void)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+
+        return _total;
+}
+
+int TimeReport::Biggest(FuncTimes &f)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+        const FuncTimes *big {nullptr};
+
+        for (auto &g : _funcs) {
+                if (big == nullptr || g.bytes > big->bytes)
+                        big = &g;
+        }
+        if (big == nullptr)
+                return 0;
+        f = *big;
+        return 1;
+}
+
+// get functions, slowest first
+static std::vector<const FuncTimes *> slowest(
+                const std::deque<FuncTimes> &funcs)
+{
+        std::vector<const FuncTimes *> v;
+
+        for (auto &f : funcs)
+                v.push_back(&f);
+        std::stable_sort(v.begin(), v.end(),
+                [](const FuncTimes *a, const FuncTimes *b) {
+                        return sum(a->t.wall) > sum(b->t.wall);
+                });
+        return v;
+}
+
+void TimeReport::Print(FILE *fp)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+        int order[NPHASES - 1];
+        auto wall = sum(_total.wall);
+
+        for (int i = 1; i < NPHASES; i++)
+                order[i - 1] = i;
+        std::stable_sort(order, order + NPHASES - 1, [this](int a, int b) {
+                return _total.wall[a] > _total.wall[b];
+        });
+
+        fprintf(fp, "time report:\n"
+                    "  %-10s %12s %12s %8s\n",
+                    "phase", "wall ms", "cpu ms", "wall %");
+        for (auto i : order) {
+                fprintf(fp, "  %-10s %12.3f %12.3f %7.1f%%\n",
+                                phase_names[i], ms(_total.wall[i]),
+                                ms(_total.cpu[i]),
+                                wall ? 100.0 * _total.wall[i] / wall : 0.0);
+        }
+        fprintf(fp, "  %-10s %12.3f %12.3f\n", "timed", ms(wall),
+                        ms(sum(_total.cpu)));
+        fprintf(fp, "  %-10s %12.3f %12.3f\n", "process",
+                        ms(now(CLOCK_MONOTONIC) - _wall),
+                        ms(now(CLOCK_PROCESS_CPUTIME_ID) - _cpu));
+
+        if (_funcs.empty())
+                return;
+
+        fprintf(fp, "slowest functions (ms):\n"
+                    "  %-20s %10s %10s", "function", "wall", "cpu");
+        for (int i = 1; i < NPHASES; i++)
+                fprintf(fp, " %8s", phase_names[i]);
+        fputc('\n', fp);
+
+        auto v = slowest(_funcs);
+        for (size_t i = 0; i < v.size() && i < SLOWEST; i++) {
+                auto &t = v[i]->t;
+                fprintf(fp, "  %-20s %10.3f %10.3f",
+                                interner.Name(v[i]->name), ms(sum(t.wall)),
+                                ms(sum(t.cpu)));
+                for (int j = 1; j < NPHASES; j++)
+                        fprintf(fp, " %8.3f", ms(t.wall[j]));
+                fputc('\n', fp);
+        }
+}
+
+// print times of each phase as a JSON object
+static void json_phases(FILE *fp, const Times &t)
+{
+        fputc('{', fp);
+        for (int i = 1; i < NPHASES; i++) {
+                fprintf(fp, "%s\"%s\": {\"wall_ns\": %llu, \"cpu_ns\": %llu}",
+                                i > 1 ? ", " : "", phase_names[i],
+                                (unsigned long long)t.wall[i],
+                                (unsigned long long)t.cpu[i]);
+        }
+        fputc('}', fp);
+}
+
+void TimeReport::Json(FILE *fp)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+
+        fprintf(fp, "{\n  \"phases\": ");
+        json_phases(fp, _total);
+        fprintf(fp, ",\n  \"timed\": {\"wall_ns\": %llu, \"cpu_ns\": %llu},\n"
+                    "  \"process\": {\"wall_ns\": %llu, \"cpu_ns\": %llu},\n"
+                    "  \"functions\": [",
+                    (unsigned long long)sum(_total.wall),
+                    (unsigned long long)sum(_total.cpu),
+                    (unsigned long long)(now(CLOCK_MONOTONIC) - _wall),
+                    (unsigned long long)
+                        (now(CLOCK_PROCESS_CPUTIME_ID) - _cpu));
+
+        auto v = slowest(_funcs);
+        for (size_t i = 0; i < v.size(); i++) {
+                auto &t = v[i]->t;
+                fprintf(fp, "%s\n    {\"name\": \"%s\", \"wall_ns\": %llu, "
+                            "\"cpu_ns\": %llu, \"phases\": ",
+                            i ? "," : "", interner.Name(v[i]->name),
+                            (unsigned long long)sum(t.wall),
+                            (unsigned long long)sum(t.cpu));
+                json_phases(fp, t);
+                fputc('}', fp);
+        }
+        fprintf(fp, "%s]\n}\n", v.empty() ? "" : "\n  ");
+}
+
+void PhaseTimer::charge(uint64_t t)
+{
+        auto d = t - clk.start;
+
+        clk.t.wall[clk.phase] += d;
+        if (clk.func)
+                clk.func->_t.wall[clk.phase] += d;
+        clk.start = t;
+}
+
+int PhaseTimer::enter(int phase)
+{
+        auto t = now(CLOCK_MONOTONIC);
+        auto prev = clk.phase;
+
+        if (clk.depth++ == 0) {
+                memset(&clk.t, 0, sizeof(clk.t));
+                clk.cpu = now(CLOCK_THREAD_CPUTIME_ID);
+                clk.start = t;
+        } else {
+                charge(t);
+        }
+        clk.phase = phase;
+        return prev;
+}
+
+void PhaseTimer::leave(int prev)
+{
+        charge(now(CLOCK_MONOTONIC));
+        clk.phase = prev;
+
+        if (--clk.depth == 0) {
+                split(clk.t, now(CLOCK_THREAD_CPUTIME_ID) - clk.cpu);
+                timereport.Add(clk.t, nullptr);
+        }
+}
+
+FuncTimer::FuncTimer(void)
+        : FuncTimer {nullptr}
+{}
+
+FuncTimer::FuncTimer(FuncTimes *f)
+        : _f {f},
+        _prev {nullptr},
+        _t {},
+        _cpu {0},
+        _allocs {0},
+        _bytes {0},
+        _on {timereport.On()}
+{
+        if (!_on)
+                return;
+
+        // a function generated inline is already being timed
+        if (f && clk.func && clk.func->_f == f) {
+                _on = 0;
+                return;
+        }
+
+        // time so far belongs to the function interrupted
+        if (clk.depth)
+                PhaseTimer::charge(now(CLOCK_MONOTONIC));
+        _prev = clk.func;
+        clk.func = this;
+        _cpu = now(CLOCK_THREAD_CPUTIME_ID);
+        _allocs = MemReport::ThreadAllocs();
+        _bytes = MemReport::ThreadBytes();
+}
+
+void FuncTimer::Name(Ident name)
+{
+        if (_on && !_f)
+                _f = timereport.Func(name);
+}
+
+FuncTimes *FuncTimer::Func(void) const
+{
+        return _f;
+}
+
+FuncTimer::~FuncTimer()
+{
+        if (!_on)
+                return;
+
+        if (clk.depth)
+                PhaseTimer::charge(now(CLOCK_MONOTONIC));
+        clk.func = _prev;
+
+        split(_t, now(CLOCK_THREAD_CPUTIME_ID) - _cpu);
+        if (_f) {
+                timereport.Add(_t, _f);
+                timereport.AddAllocs(_f, MemReport::ThreadAllocs() - _allocs,
+                                MemReport::ThreadBytes() - _bytes);
+        }
+}
+
+FuncTimes *timed_func(void)
+{
+        return clk.func ? clk.func->Func() : nullptr;
+}
+
+int timed_phase(void)
+{
+        return clk.phase;
+}
+
+const char *phase_name(int phase)
+{
+        return phase_names[phase];
+}
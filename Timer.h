@@ -0,0 +1,186 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "Intern.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+
+// phases of compilation timed by --time-report
+enum {
+        PHASE_NONE,     // outside every timer
+        PHASE_LEX,      // lexing
+        PHASE_PARSE,    // parsing
+        PHASE_TYPE,     // type checking
+        PHASE_GEN,      // code generation
+        PHASE_WRITE,    // writing out generated code
+        NPHASES,
+};
+
+// time spent in each phase, in nanoseconds
+struct Times {
+        uint64_t        wall[NPHASES];  // wall clock time
+        uint64_t        cpu[NPHASES];   // cpu time
+};
+
+// times of one function
+struct FuncTimes {
+        Ident           name;   // function name
+        Times           t;      // time of each phase
+        uint64_t        allocs; // allocations, if counting them
+        uint64_t        bytes;  // bytes allocated, if counting them
+};
+
+// compile time report
+//
+// scoped timers charge the wall clock time between them to the phase
+// they enter, and the time of a nested phase is not also charged to the
+// phase it interrupts. reading a thread's cpu clock is a system call, so
+// it is read only around a thread's outermost timer and around each
+// function, and that cpu time is split between the phases in proportion
+// to their wall clock time
+class TimeReport {
+private:
+        std::atomic<int>        _on;    // timing?
+        std::mutex              _lock;  // guards _total and _funcs
+        Times                   _total; // times of all threads
+        std::deque<FuncTimes>   _funcs; // times of each function
+        uint64_t                _wall;  // wall clock at Enable()
+        uint64_t                _cpu;   // process cpu time at Enable()
+public:
+        TimeReport(void);
+
+        TimeReport(const TimeReport &) = delete;
+        TimeReport &operator=(const TimeReport &) = delete;
+
+        // start timing
+        void Enable(void);
+
+        // timing?
+        int On(void) const
+        {
+                return _on.load(std::memory_order_relaxed);
+        }
+
+        // add a function to the report
+        //
+        // @name:       function name
+        FuncTimes *Func(Ident name);
+
+        // add times
+        //
+        // @t:          times to add
+        // @f:          function to add them to, or null for the totals
+        void Add(const Times &t, FuncTimes *f);
+
+        // add allocations to a function
+        //
+        // @f:          function
+        // @allocs:     number of allocations
+        // @bytes:      bytes allocated
+        void AddAllocs(FuncTimes *f, uint64_t allocs, uint64_t bytes);
+
+        // get times of all phases
+        Times Totals(void);
+
+        // get function that allocated the most, returns 0 if none
+        //
+        // @f:          set to function
+        int Biggest(FuncTimes &f);
+
+        // print phases and slowest functions, slowest first
+        //
+        // @fp:         file to print to
+        void Print(FILE *fp);
+
+        // print phases and every function as JSON
+        //
+        // @fp:         file to print to
+        void Json(FILE *fp);
+};
+
+// report shared by every compilation in the process
+extern TimeReport timereport;
+
+// charges the time until it is destroyed to a phase
+class PhaseTimer {
+private:
+        int     _prev;  // phase interrupted, or -1 if not timing
+
+        // charge time since the last switch to the phase being timed
+        static void charge(uint64_t now);
+
+        // switch to phase, returns the phase interrupted
+        static int enter(int phase);
+
+        // switch back to phase prev
+        static void leave(int prev);
+
+        friend class FuncTimer;
+public:
+        // @phase:      phase to time
+        PhaseTimer(int phase)
+                : _prev {-1}
+        {
+                if (timereport.On())
+                        _prev = enter(phase);
+        }
+
+        PhaseTimer(const PhaseTimer &) = delete;
+        PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+        ~PhaseTimer()
+        {
+                if (_prev >= 0)
+                        leave(_prev);
+        }
+};
+
+// charges the phases timed on this thread until it is destroyed to a
+// function
+class FuncTimer {
+private:
+        FuncTimes       *_f;    // function, or null until named
+        FuncTimer       *_prev; // timer interrupted
+        Times           _t;     // time of each phase
+        uint64_t        _cpu;   // thread cpu time when started
+        uint64_t        _allocs;// allocations on thread when started
+        uint64_t        _bytes; // bytes allocated on thread when started
+        int             _on;    // timing?
+
+        friend class PhaseTimer;
+public:
+        // time a function named later with Name()
+        FuncTimer(void);
+
+        // @f:          function to time, may be null
+        FuncTimer(FuncTimes *f);
+
+        FuncTimer(const FuncTimer &) = delete;
+        FuncTimer &operator=(const FuncTimer &) = delete;
+
+        // name function being timed
+        //
+        // @name:       function name
+        void Name(Ident name);
+
+        // get times of function, or null if not timing
+        FuncTimes *Func(void) const;
+
+        ~FuncTimer();
+};
+
+// get function being timed on this thread, or null
+extern FuncTimes *timed_func(void);
+
+// get phase being timed on this thread
+extern int timed_phase(void);
+
+// get name of phase
+//
+// @phase:      phase
+extern const char *phase_name(int phase);
+
+#endif
@@ -0,0 +1,70 @@
+#include "TokBuf.h"
+#include "Mem.h"
+
+TokBuf::TokBuf(const char *src)
+        : _src {src},
+        _kind {},
+        _off {},
+        _len {},
+        _id {}
+{}
+
+void TokBuf::Reserve(size_t n)
+{
+        MemTag mt {MEM_TOKEN};
+
+        _kind.reserve(n);
+        _off.reserve(n);
+        _len.reserve(n);
+        _id.reserve(n);
+}
+
+void TokBuf::Push(const Token &tok)
+{
+        MemTag mt {MEM_TOKEN};
+
+        if (tok.Off() > UINT32_MAX || tok.Len() > UINT32_MAX)
+                usage("input too large to pretokenize");
+
+        _kind.push_back(tok.Type());
+        _off.push_back(tok.Off());
+        _len.push_back(tok.Len());
+        _id.push_back(tok.Id());
+}
+
+size_t TokBuf::Size(void) const
+{
+        return _kind.size();
+}
+
+int TokBuf::Kind(size_t i) const
+{
+        return _kind[i];
+}
+
+Token TokBuf::Get(size_t i) const
+{
+        if (_kind[i] == TOK_IDENT)
+                return Token{_src, _off[i], _len[i], _id[i]};
+        return Token{_kind[i], _src, _off[i], _len[i]};
+}
+
+size_t TokBuf::Bytes(void) const
+{
+        return _kind.capacity() * sizeof(_kind[0]) +
+                _off.capacity() * sizeof(_off[0]) +
+                _len.capacity() * sizeof(_len[0]) +
+                _id.capacity() * sizeof(_id[0]);
+}
+
+void TokBuf::Report(FILE *fp) const
+{
+        auto n = Size();
+        auto used = n * (sizeof(_kind[0]) + sizeof(_off[0]) +
+                        sizeof(_len[0]) + sizeof(_id[0]));
+
+        fprintf(fp, "tokens: %zu, %zu bytes used, %zu bytes reserved, "
+                        "%.2f bytes/token\n",
+                        n, used, Bytes(),
+                        n == 0 ? 0.0 : (double)Bytes() / n);
+}
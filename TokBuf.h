@@ -0,0 +1,45 @@
+#ifndef TOKBUF_H
+#define TOKBUF_H
+
+#include "Error.h"
+#include "Intern.h"
+#include "Token.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// whole translation unit of tokens, stored as parallel arrays
+class TokBuf {
+private:
+        const char              *_src;  // source buffer tokens point into
+        std::vector<uint8_t>    _kind;  // token types
+        std::vector<uint32_t>   _off;   // offsets of lexemes
+        std::vector<uint32_t>   _len;   // lengths of lexemes
+        std::vector<Ident>      _id;    // interned ids (TOK_IDENT only)
+public:
+        // @src:        source buffer tokens point into
+        TokBuf(const char *src);
+
+        // reserve room for n tokens
+        void Reserve(size_t n);
+
+        // append token
+        void Push(const Token &tok);
+
+        // get number of tokens
+        size_t Size(void) const;
+
+        // get token type of token i
+        int Kind(size_t i) const;
+
+        // get token i
+        Token Get(size_t i) const;
+
+        // get bytes held by token arrays
+        size_t Bytes(void) const;
+
+        // print memory use per token
+        void Report(FILE *fp) const;
+};
+
+#endif
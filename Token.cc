@@ -1,12 +1,23 @@
 #include "Token.h"
+#include "Mem.h"
 
 Token::Token(void)
-        : _lex {""},
+        : _src {""},
+        _off {0},
+        _len {0},
+        _id {0},
         _type {TOK_EOF}
 {}
 
-Token::Token(int type, const std::string &lex)
-        : _lex {lex},
+Token::Token(int type, const char *lex)
+        : Token{type, lex, 0, strlen(lex)}
+{}
+
+Token::Token(int type, const char *src, size_t off, size_t len)
+        : _src {src},
+        _off {off},
+        _len {len},
+        _id {0},
         _type {type}
 {
         switch (_type) {
@@ -49,6 +60,14 @@ Token::Token(int type, const std::string &lex)
         }
 }
 
+Token::Token(const char *src, size_t off, size_t len, Ident id)
+        : _src {src},
+        _off {off},
+        _len {len},
+        _id {id},
+        _type {TOK_IDENT}
+{}
+
 int Token::Type(void) const
 {
         return _type;
@@ -56,12 +75,35 @@ int Token::Type(void) const
 
 std::string Token::Lex(void) const
 {
-        return _lex;
+        MemTag mt {MEM_TOKEN};
+
+        return std::string{_src + _off, _len};
+}
+
+const char *Token::Ptr(void) const
+{
+        return _src + _off;
+}
+
+size_t Token::Off(void) const
+{
+        return _off;
+}
+
+size_t Token::Len(void) const
+{
+        return _len;
+}
+
+Ident Token::Id(void) const
+{
+        return _id;
 }
 
 
 std::string Token::Name(void) const
 {
+        MemTag mt {MEM_TOKEN};
         std::vector<std::string> names {
                 "TOK_EOF",
                 "TOK_ASSIGN",
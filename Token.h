@@ -2,6 +2,8 @@
 #define TOKEN_H
 
 #include "Error.h"
+#include "Intern.h"
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -43,17 +45,35 @@ enum {
 };
 
 // token
+//
+// the lexeme is not owned: it is a view of _len bytes at _off in the
+// source buffer _src, so the buffer must outlive the token
 class Token {
 private:
-        std::string     _lex;   // lexeme
+        const char      *_src;  // source buffer lexeme points into
+        size_t          _off;   // offset of lexeme in _src
+        size_t          _len;   // length of lexeme
+        Ident           _id;    // interned identifier (TOK_IDENT only)
         int             _type;  // token type
 public:
         // default constructor
         Token(void);
 
         // @type:       token type
-        // @lex:        lexeme
-        Token(int type, const std::string &lex);
+        // @lex:        static lexeme
+        Token(int type, const char *lex);
+
+        // @type:       token type
+        // @src:        source buffer
+        // @off:        offset of lexeme in src
+        // @len:        length of lexeme
+        Token(int type, const char *src, size_t off, size_t len);
+
+        // @src:        source buffer
+        // @off:        offset of identifier in src
+        // @len:        length of identifier
+        // @id:         interned identifier
+        Token(const char *src, size_t off, size_t len, Ident id);
 
         // get token type
         int Type(void) const;
@@ -61,6 +81,18 @@ public:
         // get lexeme
         std::string Lex(void) const;
 
+        // get pointer to first byte of lexeme
+        const char *Ptr(void) const;
+
+        // get offset of lexeme in source buffer
+        size_t Off(void) const;
+
+        // get length of lexeme
+        size_t Len(void) const;
+
+        // get interned identifier
+        Ident Id(void) const;
+
         // get token type name
         std::string Name(void) const;
 };
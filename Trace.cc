@@ -0,0 +1,104 @@
+#include "Trace.h"
+#include "Intern.h"
+#include <ctime>
+#include <unistd.h>
+
+Trace trace;
+
+// buffer of this thread or null
+static thread_local TraceBuf *tbuf;
+
+Trace::Trace(void)
+        : _on {0},
+        _lock {},
+        _bufs {},
+        _start {0}
+{}
+
+void Trace::Enable(void)
+{
+        _start = TraceSpan::now();
+        _on.store(1, std::memory_order_relaxed);
+}
+
+TraceBuf *Trace::Buf(void)
+{
+        if (tbuf)
+                return tbuf;
+
+        std::lock_guard<std::mutex> lk {_lock};
+
+        _bufs.emplace_back(new TraceBuf{(int)_bufs.size() + 1, {}});
+        tbuf = _bufs.back().get();
+        return tbuf;
+}
+
+// write string as a JSON string
+static void json_str(FILE *fp, const char *s)
+{
+        fputc('"', fp);
+        for (; *s; s++) {
+                auto c = (unsigned char)*s;
+                if (c == '"' || c == '\\')
+                        fprintf(fp, "\\%c", c);
+                else if (c < ' ')
+                        fprintf(fp, "\\u%04x", c);
+                else
+                        fputc(c, fp);
+        }
+        fputc('"', fp);
+}
+
+void Trace::Write(FILE *fp)
+{
+        std::lock_guard<std::mutex> lk {_lock};
+        auto pid = (int)getpid();
+        const char *sep {""};
+
+        fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+        for (auto &b : _bufs) {
+                fprintf(fp, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+                            "\"pid\": %d, \"tid\": %d, "
+                            "\"args\": {\"name\": \"thread %d\"}}",
+                            sep, pid, b->tid, b->tid);
+                sep = ",";
+
+                for (auto &e : b->events) {
+                        // timestamps are in microseconds
+                        fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", "
+                                    "\"pid\": %d, \"tid\": %d, "
+                                    "\"ts\": %.3f, \"dur\": %.3f",
+                                    e.name, pid, b->tid,
+                                    (e.start - _start) / 1e3, e.dur / 1e3);
+                        if (e.arg) {
+                                fprintf(fp, ", \"args\": {\"name\": ");
+                                json_str(fp, e.arg);
+                                fputc('}', fp);
+                        }
+                        fputc('}', fp);
+                }
+        }
+        fprintf(fp, "\n]}\n");
+}
+
+uint64_t TraceSpan::now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void TraceSpan::end(void)
+{
+        auto t = now();
+
+        trace.Buf()->events.push_back(TraceEvent{_name, _arg, _start,
+                        t - _start});
+}
+
+void TraceSpan::Arg(const std::string &path)
+{
+        if (_start)
+                _arg = interner.Name(interner.Intern(path));
+}
@@ -0,0 +1,108 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// one span of a trace
+struct TraceEvent {
+        const char      *name;  // what was done, a string literal
+        const char      *arg;   // file or function it was done to, or null
+        uint64_t        start;  // wall clock at start, in nanoseconds
+        uint64_t        dur;    // length in nanoseconds
+};
+
+// events of one thread
+struct TraceBuf {
+        int                     tid;    // thread number in the trace
+        std::vector<TraceEvent> events; // events in order of ending
+};
+
+// timeline written by --trace
+//
+// every thread appends the spans it ends to a buffer of its own, so
+// tracing takes no lock but the one a thread takes the first time it
+// traces. buffers are kept until the process exits and are written as
+// Chrome trace event JSON, which chrome://tracing and Perfetto read
+class Trace {
+private:
+        std::atomic<int>                        _on;    // tracing?
+        std::mutex                              _lock;  // guards _bufs
+        std::deque<std::unique_ptr<TraceBuf>>   _bufs;  // every thread's
+        uint64_t                                _start; // wall clock at
+                                                        // Enable()
+public:
+        Trace(void);
+
+        Trace(const Trace &) = delete;
+        Trace &operator=(const Trace &) = delete;
+
+        // start tracing
+        void Enable(void);
+
+        // tracing?
+        int On(void) const
+        {
+                return _on.load(std::memory_order_relaxed);
+        }
+
+        // get buffer of this thread, making it on first use
+        TraceBuf *Buf(void);
+
+        // write every thread's events; threads must be done tracing
+        //
+        // @fp:         file to write to
+        void Write(FILE *fp);
+};
+
+// trace shared by every compilation in the process
+extern Trace trace;
+
+// adds a span to the trace from when it is made until it is destroyed
+class TraceSpan {
+private:
+        const char      *_name; // what is being done
+        const char      *_arg;  // file or function, or null
+        uint64_t        _start; // wall clock at start, or 0 if not tracing
+
+        // read wall clock
+        static uint64_t now(void);
+
+        // add span to this thread's buffer
+        void end(void);
+
+        friend class Trace;
+public:
+        // @name:       what is being done, a string literal
+        // @arg:        name of function, from the interner, or null
+        TraceSpan(const char *name, const char *arg = nullptr)
+                : _name {name},
+                _arg {arg},
+                _start {0}
+        {
+                if (trace.On())
+                        _start = now();
+        }
+
+        TraceSpan(const TraceSpan &) = delete;
+        TraceSpan &operator=(const TraceSpan &) = delete;
+
+        // name the file being worked on
+        //
+        // @path:       path name of file, interned if tracing
+        void Arg(const std::string &path);
+
+        ~TraceSpan()
+        {
+                if (_start)
+                        end();
+        }
+};
+
+#endif
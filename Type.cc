@@ -1,9 +1,12 @@
 #include "Type.h"
 #include "CodeGen.h"
 #include "Ast.h"
+#include "Timer.h"
 
 int type_compat(CodeGen& cg, int *left, int *right, int onlyright)
 {
+        PhaseTimer pt {PHASE_TYPE};
+
         if (*left == *right) {
                 *left = 0;
                 *right = 0;
@@ -121,13 +124,14 @@ static int ptrtype(int type)
         return 0;
 }
 
-Ast *modify_type(CodeGen& cg, Ast *n, int rtype, int op)
+AstRef modify_type(CodeGen& cg, AstPool& ast, AstRef n, int rtype, int op)
 {
+        PhaseTimer pt {PHASE_TYPE};
         int ltype;
         int lsize;
         int rsize;
 
-        ltype = n->Dtype();
+        ltype = ast[n].Dtype();
         if (inttype(ltype) && inttype(rtype)) {
                 if (ltype == rtype)
                         return n;
@@ -135,9 +139,9 @@ Ast *modify_type(CodeGen& cg, Ast *n, int rtype, int op)
                 lsize = cg.PrimSize(ltype);
                 rsize = cg.PrimSize(rtype);
                 if (lsize > rsize)
-                        return nullptr;
+                        return NIL_AST;
                 if (rsize > lsize)
-                        return new Ast{AST_WIDEN, rtype, n, 0};
+                        return ast.New(AST_WIDEN, rtype, n, NIL_AST, 0);
         }
 
         if (ptrtype(ltype)) {
@@ -149,9 +153,10 @@ Ast *modify_type(CodeGen& cg, Ast *n, int rtype, int op)
                 if (inttype(ltype) && ptrtype(rtype)) {
                         rsize = cg.PrimSize(val_at(rtype));
                         if (rsize > 1)
-                                return new Ast{AST_SCALE, rtype, n, rsize};
+                                return ast.New(AST_SCALE, rtype, n, NIL_AST,
+                                                rsize);
                 }
         }
 
-        return nullptr;
+        return NIL_AST;
 }
@@ -3,6 +3,7 @@
 
 #include "Ast.h"
 #include "Error.h"
+#include <cstdint>
 #include <string>
 
 // primitive data types
@@ -26,7 +27,8 @@ enum {
 };
 
 class CodeGen;
-class Ast;
+class AstPool;
+typedef uint32_t AstRef;
 
 int type_compat(CodeGen& cg, int *left, int *right, int onlyright);
 
@@ -38,6 +40,6 @@ int ptr_to(int type);
 
 int val_at(int type);
 
-Ast *modify_type(CodeGen& cg, Ast *n, int rtype, int op);
+AstRef modify_type(CodeGen& cg, AstPool& ast, AstRef n, int rtype, int op);
 
 #endif
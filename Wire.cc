@@ -0,0 +1,72 @@
+#include "Wire.h"
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+
+// read exactly n bytes; 0 if input ends first, -1 on error
+static int read_full(int fd, char *p, size_t n)
+{
+        while (n > 0) {
+                auto got = read(fd, p, n);
+                if (got < 0 && errno == EINTR)
+                        continue;
+                if (got < 0)
+                        return -1;
+                if (got == 0)
+                        return 0;
+                p += got;
+                n -= got;
+        }
+        return 1;
+}
+
+static int write_full(int fd, const char *p, size_t n)
+{
+        while (n > 0) {
+                auto put = write(fd, p, n);
+                if (put < 0 && errno == EINTR)
+                        continue;
+                if (put < 0)
+                        return -1;
+                p += put;
+                n -= put;
+        }
+        return 0;
+}
+
+int read_msg(int fd, int &kind, std::string &body, size_t max)
+{
+        unsigned char hdr[9];
+        uint64_t len {0};
+        int r;
+
+        if ((r = read_full(fd, reinterpret_cast<char *>(hdr), 1)) <= 0)
+                return r;
+        if (read_full(fd, reinterpret_cast<char *>(hdr + 1), 8) <= 0)
+                return -1;
+
+        for (int i = 8; i > 0; i--)
+                len = len << 8 | hdr[i];
+
+        kind = hdr[0];
+        if (len > max)
+                return -2;
+        body.resize(len);
+        if (len > 0 && read_full(fd, &body[0], len) <= 0)
+                return -1;
+        return 1;
+}
+
+int write_msg(int fd, int kind, const char *buf, size_t len)
+{
+        unsigned char hdr[9];
+        uint64_t n = len;
+
+        hdr[0] = kind;
+        for (int i = 1; i < 9; i++, n >>= 8)
+                hdr[i] = n & 0xff;
+
+        if (write_full(fd, reinterpret_cast<char *>(hdr), sizeof(hdr)) < 0)
+                return -1;
+        return write_full(fd, buf, len);
+}
@@ -0,0 +1,38 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <cstddef>
+#include <string>
+
+// messages between compile server and client
+//
+// a message is a kind byte, an 8 byte little endian body length and
+// the body
+#define MSG_PATH        'P'     // request: compile file at path in body
+#define MSG_SOURCE      'S'     // request: compile source text in body
+#define MSG_ASM         'A'     // reply: assembly
+#define MSG_ERROR       'E'     // reply: compile failed, body says why
+
+// longest request body a server reads; anything longer gets MSG_ERROR
+#define MSG_MAX         (1ul << 30)
+
+// read a message
+//
+// @fd:         socket
+// @kind:       set to message kind
+// @body:       set to message body
+// @max:        longest body to read
+// @return:     1 on message, 0 on end of input, -1 on error, -2 if the
+//              body is longer than max
+extern int read_msg(int fd, int &kind, std::string &body, size_t max);
+
+// write a message
+//
+// @fd:         socket
+// @kind:       message kind
+// @buf:        body
+// @len:        length of body
+// @return:     0 on success, -1 on error, EPIPE too if the peer hung up
+extern int write_msg(int fd, int kind, const char *buf, size_t len);
+
+#endif